@@ -4,6 +4,7 @@
 #include <algorithm>
 
 #include "SpaceHub/src/orbits/orbits.hpp"
+#include "orbit_context.h"
 #include "tools.h"
 
 namespace secular {
@@ -162,42 +163,127 @@ void initialize_orbit_args(LK_method method, Container &c, Iter iter) {
   } else {
     throw ReturnFlag::input_err;
   }
-  std::copy_n(iter + 13, 9, c.spin_begin());
+  std::copy_n(iter + 13, 3 * Container::s_num, c.spin_begin());
+}
+
+/*
+ * The outer orbit of an SA state (r, v) as the DA vectors (L2, e2) of the osculating Kepler orbit. Both
+ * representations share the slots 6-11 of the state, so the conversion is done in place.
+ */
+template <typename Args, typename Container>
+void SA_to_DA(Args const &args, Container &c) {
+  double const mu = consts::G * args.m_tot();
+
+  double const r = norm(c.rx(), c.ry(), c.rz());
+
+  auto const [hx, hy, hz] = cross(c.rx(), c.ry(), c.rz(), c.vx(), c.vy(), c.vz());
+
+  auto const [qx, qy, qz] = cross(c.vx(), c.vy(), c.vz(), hx, hy, hz);
+
+  double const e2x = qx / mu - c.rx() / r, e2y = qy / mu - c.ry() / r, e2z = qz / mu - c.rz() / r;
+
+  c.set_L2(args.mu_out() * hx, args.mu_out() * hy, args.mu_out() * hz);
+
+  c.set_e2(e2x, e2y, e2z);
+}
+
+/* inverse of SA_to_DA: put the outer body on the orbit (L2, e2) at mean anomaly M (in rad) */
+template <typename Args, typename Container>
+void DA_to_SA(Args const &args, Container &c, double M) {
+  auto const [e_sqr, j_sqr, j, L_norm, L, a] =
+      calc_orbit_args(args.a_out_coef(), c.L2x(), c.L2y(), c.L2z(), c.e2x(), c.e2y(), c.e2z());
+
+  double const e = sqrt(e_sqr);
+
+  double const nx = c.L2x() / L_norm, ny = c.L2y() / L_norm, nz = c.L2z() / L_norm;
+
+  double ux, uy, uz;
+
+  if (e > 1e-12) {
+    ux = c.e2x() / e, uy = c.e2y() / e, uz = c.e2z() / e;
+  } else {  // a circular orbit has no pericenter; any direction in the orbital plane will do
+    std::tie(ux, uy, uz) = fabs(nz) < 0.9 ? cross(nx, ny, nz, 0, 0, 1) : cross(nx, ny, nz, 1, 0, 0);
+    double const u = norm(ux, uy, uz);
+    ux /= u, uy /= u, uz /= u;
+  }
+
+  auto const [qx, qy, qz] = cross(nx, ny, nz, ux, uy, uz);
+
+  double const E_nu = space::orbit::M_anomaly_to_E_anomaly(M, e);
+
+  double const nu = space::orbit::E_anomaly_to_T_anomaly(E_nu, e);
+
+  double const r = a * (1 - e * cos(E_nu));
+
+  double const v = sqrt(consts::G * args.m_tot() / (a * j_sqr));
+
+  double const cos_nu = cos(nu), sin_nu = sin(nu);
+
+  double const ve = -v * sin_nu, vq = v * (e + cos_nu);
+
+  c.set_r(r * (cos_nu * ux + sin_nu * qx), r * (cos_nu * uy + sin_nu * qy), r * (cos_nu * uz + sin_nu * qz));
+
+  c.set_v(ve * ux + vq * qx, ve * uy + vq * qy, ve * uz + vq * qz);
+}
+
+/*
+ * How well the double average holds: the time the inner orbit needs to change its angular momentum by order
+ * itself, t_LK * sqrt(1 - e_in^2), over the outer period. The inner orbit is a lot more eccentric at the LK peak,
+ * so the ratio is smallest there; below ~1 the outer orbit can no longer be averaged over.
+ */
+template <typename Args, typename Container>
+double DA_validity(Args const &args, Container const &c, LK_method method) {
+  auto const [a_in, j1] = calc_a_j(args.a_in_coef(), c.L1x(), c.L1y(), c.L1z(), c.e1x(), c.e1y(), c.e1z());
+
+  double a_out, j2;
+
+  if (method == LK_method::DA) {
+    std::tie(a_out, j2) = calc_a_j(args.a_out_coef(), c.L2x(), c.L2y(), c.L2z(), c.e2x(), c.e2y(), c.e2z());
+  } else {
+    Container osc = c;
+    SA_to_DA(args, osc);
+    std::tie(a_out, j2) = calc_a_j(args.a_out_coef(), osc.L2x(), osc.L2y(), osc.L2z(), osc.e2x(), osc.e2y(), osc.e2z());
+  }
+
+  double const P_out = 2 * consts::pi * sqrt(a_out * a_out * a_out / (consts::G * args.m_tot()));
+
+  return t_k_quad(args.m12(), args.m3(), a_in, a_out * j2) * j1 / P_out;
 }
 
 template <typename Ctrl, typename Args, typename Container>
-void double_aved_LK(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar) {
-  auto [e1_sqr, j1_sqr, j1, L1_norm, L_in, a_in] =
-      calc_orbit_args(args.a_in_coef(), var.L1x(), var.L1y(), var.L1z(), var.e1x(), var.e1y(), var.e1z());
+void double_aved_LK(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar,
+                    Orbit_context const &orbits) {
+  double const e1_sqr = orbits.in.e_sqr, L_in = orbits.in.L, a_in = orbits.in.a;
+
+  double const j2_sqr = orbits.out.j_sqr, j2 = orbits.out.j, L2_norm = orbits.out.L_norm, a_out = orbits.out.a;
 
-  auto [e2_sqr, j2_sqr, j2, L2_norm, L_out, a_out] =
-      calc_orbit_args(args.a_out_coef(), var.L2x(), var.L2y(), var.L2z(), var.e2x(), var.e2y(), var.e2z());
+  Vec3 const e1 = var.e1(), e2 = var.e2();
   /*---------------------------------------------------------------------------*\
           unit vectors
   \*---------------------------------------------------------------------------*/
-  double j1x = var.L1x() / L_in, j1y = var.L1y() / L_in, j1z = var.L1z() / L_in;
+  Vec3 const j1 = var.L1() / L_in;
 
-  double n2x = var.L2x() / L2_norm, n2y = var.L2y() / L2_norm, n2z = var.L2z() / L2_norm;
+  Vec3 const n2 = var.L2() / L2_norm;
   /*---------------------------------------------------------------------------*\
           dot production
   \*---------------------------------------------------------------------------*/
-  double dj1n2 = dot(j1x, j1y, j1z, n2x, n2y, n2z);
+  double dj1n2 = dot(j1, n2);
 
-  double de1n2 = dot(var.e1x(), var.e1y(), var.e1z(), n2x, n2y, n2z);
+  double de1n2 = dot(e1, n2);
   /*---------------------------------------------------------------------------*\
           cross production
   \*---------------------------------------------------------------------------*/
-  auto const [cj1n2_x, cj1n2_y, cj1n2_z] = cross(j1x, j1y, j1z, n2x, n2y, n2z);
+  Vec3 const cj1n2 = cross(j1, n2);
 
-  auto const [cj1e1_x, cj1e1_y, cj1e1_z] = cross(j1x, j1y, j1z, var.e1x(), var.e1y(), var.e1z());
+  Vec3 const cj1e1 = cross(j1, e1);
 
-  auto const [ce1n2_x, ce1n2_y, ce1n2_z] = cross(var.e1x(), var.e1y(), var.e1z(), n2x, n2y, n2z);
+  Vec3 const ce1n2 = cross(e1, n2);
 
-  auto const [ce2j1_x, ce2j1_y, ce2j1_z] = cross(var.e2x(), var.e2y(), var.e2z(), j1x, j1y, j1z);
+  Vec3 const ce2j1 = cross(e2, j1);
 
-  auto const [ce1e2_x, ce1e2_y, ce1e2_z] = cross(var.e1x(), var.e1y(), var.e1z(), var.e2x(), var.e2y(), var.e2z());
+  Vec3 const ce1e2 = cross(e1, e2);
 
-  auto const [cn2e2_x, cn2e2_y, cn2e2_z] = cross(n2x, n2y, n2z, var.e2x(), var.e2y(), var.e2z());
+  Vec3 const cn2e2 = cross(n2, e2);
   /*---------------------------------------------------------------------------*\
           combinations
   \*---------------------------------------------------------------------------*/
@@ -227,30 +313,24 @@ void double_aved_LK(Ctrl const &ctrl, Args const &args, Container const &var, Co
 
   double const C3 = -C * (0.5 - 3 * e1_sqr + 12.5 * de1n2 * de1n2 - 2.5 * dj1n2 * dj1n2);
 
-  double const dLx = A1 * cj1n2_x + A2 * ce1n2_x;
+  Vec3 const dL = A1 * cj1n2 + A2 * ce1n2;
 
-  double const dLy = A1 * cj1n2_y + A2 * ce1n2_y;
+  dvar.add_L1(dL);
 
-  double const dLz = A1 * cj1n2_z + A2 * ce1n2_z;
+  dvar.add_e1(B1 * ce1n2 + B2 * cj1e1 + B3 * cj1n2);
 
-  dvar.add_L1(dLx, dLy, dLz);
+  dvar.sub_L2(dL);
 
-  dvar.add_e1(B1 * ce1n2_x + B2 * cj1e1_x + B3 * cj1n2_x, B1 * ce1n2_y + B2 * cj1e1_y + B3 * cj1n2_y,
-              B1 * ce1n2_z + B2 * cj1e1_z + B3 * cj1n2_z);
-
-  dvar.sub_L2(dLx, dLy, dLz);
-
-  dvar.add_e2(C1 * ce1e2_x + C2 * ce2j1_x + C3 * cn2e2_x, C1 * ce1e2_y + C2 * ce2j1_y + C3 * cn2e2_y,
-              C1 * ce1e2_z + C2 * ce2j1_z + C3 * cn2e2_z);
+  dvar.add_e2(C1 * ce1e2 + C2 * ce2j1 + C3 * cn2e2);
 
   if (ctrl.Oct == true) {
     double const oct_coef = -25.0 / 16 * quad_coef * normed_oct_epsilon(args.m1(), args.m2(), a_in, a_out_eff) / j2;
 
-    auto const [cj1e2_x, cj1e2_y, cj1e2_z] = cross(j1x, j1y, j1z, var.e2x(), var.e2y(), var.e2z());
+    Vec3 const cj1e2 = cross(j1, e2);
 
-    double const de1e2 = dot(var.e1x(), var.e1y(), var.e1z(), var.e2x(), var.e2y(), var.e2z());
+    double const de1e2 = dot(e1, e2);
 
-    double const dj1e2 = dot(j1x, j1y, j1z, var.e2x(), var.e2y(), var.e2z());
+    double const dj1e2 = dot(j1, e2);
 
     double const shared_C1 = 1.6 * e1_sqr - 0.2 - 7 * de1n2 * de1n2 + dj1n2 * dj1n2;
 
@@ -277,54 +357,48 @@ void double_aved_LK(Ctrl const &ctrl, Args const &args, Container const &var, Co
     double const G5 =
         -oct_coef * G * ((0.4 - 3.2 * e1_sqr) * de1e2 + 14 * de1n2 * dj1e2 * dj1n2 + 7 * de1e2 * shared_C1);
 
-    double const oct_dLx = L_in * (E1 * cj1n2_x + E2 * ce1n2_x + E3 * cj1e2_x + E4 * ce1e2_x);
-
-    double const oct_dLy = L_in * (E1 * cj1n2_y + E2 * ce1n2_y + E3 * cj1e2_y + E4 * ce1e2_y);
+    Vec3 const oct_dL = L_in * (E1 * cj1n2 + E2 * ce1n2 + E3 * cj1e2 + E4 * ce1e2);
 
-    double const oct_dLz = L_in * (E1 * cj1n2_z + E2 * ce1n2_z + E3 * cj1e2_z + E4 * ce1e2_z);
+    dvar.add_L1(oct_dL);
 
-    dvar.add_L1(oct_dLx, oct_dLy, oct_dLz);
+    dvar.add_L2(-oct_dL);
 
-    dvar.add_L2(-oct_dLx, -oct_dLy, -oct_dLz);
+    dvar.add_e1(E1 * ce1n2 + E2 * cj1n2 + E3 * ce1e2 + E4 * cj1e2 + E5 * cj1e1);
 
-    dvar.add_e1(E1 * ce1n2_x + E2 * cj1n2_x + E3 * ce1e2_x + E4 * cj1e2_x + E5 * cj1e1_x,
-                E1 * ce1n2_y + E2 * cj1n2_y + E3 * ce1e2_y + E4 * cj1e2_y + E5 * cj1e1_y,
-                E1 * ce1n2_z + E2 * cj1n2_z + E3 * ce1e2_z + E4 * cj1e2_z + E5 * cj1e1_z);
-
-    dvar.add_e2(G1 * cj1e2_x + G2 * ce1e2_x + G3 * cj1n2_x + G4 * ce1n2_x + G5 * cn2e2_x,
-                G1 * cj1e2_y + G2 * ce1e2_y + G3 * cj1n2_y + G4 * ce1n2_y + G5 * cn2e2_y,
-                G1 * cj1e2_z + G2 * ce1e2_z + G3 * cj1n2_z + G4 * ce1n2_z + G5 * cn2e2_z);
+    dvar.add_e2(G1 * cj1e2 + G2 * ce1e2 + G3 * cj1n2 + G4 * ce1n2 + G5 * cn2e2);
   }
 }
 
 template <typename Ctrl, typename Args, typename Container>
-void single_aved_LK(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar) {
-  auto [e1_sqr, j1_sqr, j1, L1_norm, L_in, a_in] =
-      calc_orbit_args(args.a_in_coef(), var.L1x(), var.L1y(), var.L1z(), var.e1x(), var.e1y(), var.e1z());
+void single_aved_LK(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar,
+                    Orbit_context const &orbits) {
+  double const e1_sqr = orbits.in.e_sqr, L_in = orbits.in.L, a_in = orbits.in.a;
+
+  double const r2 = orbits.r_sqr;
 
-  double const r2 = norm2(var.rx(), var.ry(), var.rz());
+  double const r = orbits.r;
 
-  double const r = sqrt(r2);
+  Vec3 const e1 = var.e1();
   /*---------------------------------------------------------------------------*\
           unit vectors
       \*---------------------------------------------------------------------------*/
-  double const j1x = var.L1x() / L_in, j1y = var.L1y() / L_in, j1z = var.L1z() / L_in;
+  Vec3 const j1 = var.L1() / L_in;
 
-  double const rhox = var.rx() / r, rhoy = var.ry() / r, rhoz = var.rz() / r;
+  Vec3 const rho = var.r() / r;
   /*---------------------------------------------------------------------------*\
           dot production
       \*---------------------------------------------------------------------------*/
-  double const dj1rho = dot(j1x, j1y, j1z, rhox, rhoy, rhoz);
+  double const dj1rho = dot(j1, rho);
 
-  double const de1rho = dot(var.e1x(), var.e1y(), var.e1z(), rhox, rhoy, rhoz);
+  double const de1rho = dot(e1, rho);
   /*---------------------------------------------------------------------------*\
           cross production
       \*---------------------------------------------------------------------------*/
-  auto const [cj1rho_x, cj1rho_y, cj1rho_z] = cross(j1x, j1y, j1z, rhox, rhoy, rhoz);
+  Vec3 const cj1rho = cross(j1, rho);
 
-  auto const [cj1e1_x, cj1e1_y, cj1e1_z] = cross(j1x, j1y, j1z, var.e1x(), var.e1y(), var.e1z());
+  Vec3 const cj1e1 = cross(j1, e1);
 
-  auto const [ce1rho_x, ce1rho_y, ce1rho_z] = cross(var.e1x(), var.e1y(), var.e1z(), rhox, rhoy, rhoz);
+  Vec3 const ce1rho = cross(e1, rho);
   /*---------------------------------------------------------------------------*\
           combinations
       \*---------------------------------------------------------------------------*/
@@ -355,15 +429,13 @@ void single_aved_LK(Ctrl const &ctrl, Args const &args, Container const &var, Co
 
   double const acc_e = -D * 10 * de1rho / r4;
 
-  dvar.add_L1(A1 * ce1rho_x + A2 * cj1rho_x, A1 * ce1rho_y + A2 * cj1rho_y, A1 * ce1rho_z + A2 * cj1rho_z);
+  dvar.add_L1(A1 * ce1rho + A2 * cj1rho);
 
-  dvar.add_e1(B1 * cj1rho_x + B2 * ce1rho_x + B3 * cj1e1_x, B1 * cj1rho_y + B2 * ce1rho_y + B3 * cj1e1_y,
-              B1 * cj1rho_z + B2 * ce1rho_z + B3 * cj1e1_z);
+  dvar.add_e1(B1 * cj1rho + B2 * ce1rho + B3 * cj1e1);
 
-  dvar.set_r(var.vx(), var.vy(), var.vz());
+  dvar.set_r(var.v());
 
-  dvar.add_v(acc_r * var.rx() + acc_n * j1x + acc_e * var.e1x(), acc_r * var.ry() + acc_n * j1y + acc_e * var.e1y(),
-             acc_r * var.rz() + acc_n * j1z + acc_e * var.e1z());
+  dvar.add_v(acc_r * var.r() + acc_n * j1 + acc_e * e1);
 
   if (ctrl.Oct == true) {
     double const epsilon = normed_oct_epsilon(args.m1(), args.m2(), a_in, r);
@@ -382,19 +454,19 @@ void single_aved_LK(Ctrl const &ctrl, Args const &args, Container const &var, Co
 
     double const H2 = F2 * L_in;
 
-    dvar.add_L1(H1 * cj1e1_x + H2 * ce1rho_x, H1 * cj1e1_y + H2 * ce1rho_y, H1 * cj1e1_z + H2 * ce1rho_z);
+    dvar.add_L1(H1 * cj1e1 + H2 * ce1rho);
 
-    dvar.add_e1(F1 * cj1e1_x + F2 * cj1rho_x + F3 * ce1rho_x, F1 * cj1e1_y + F2 * cj1rho_y + F3 * ce1rho_y,
-                F1 * cj1e1_z + F2 * cj1rho_z + F3 * ce1rho_z);
+    dvar.add_e1(F1 * cj1e1 + F2 * cj1rho + F3 * ce1rho);
   }
 }
 
 template <typename Ctrl, typename Args, typename Container>
-inline void Lidov_Kozai(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar) {
+inline void Lidov_Kozai(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar,
+                        Orbit_context const &orbits) {
   if (ctrl.ave_method == LK_method::DA) {
-    double_aved_LK(ctrl, args, var, dvar);
+    double_aved_LK(ctrl, args, var, dvar, orbits);
   } else if (ctrl.ave_method == LK_method::SA) {
-    single_aved_LK(ctrl, args, var, dvar);
+    single_aved_LK(ctrl, args, var, dvar, orbits);
   }
 }
 
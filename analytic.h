@@ -0,0 +1,295 @@
+#ifndef SECULAR_ANALYTIC_H
+#define SECULAR_ANALYTIC_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <tuple>
+#include <utility>
+
+#include "LK.h"
+#include "boost/math/special_functions/ellint_1.hpp"
+#include "boost/math/special_functions/ellint_3.hpp"
+#include "boost/math/special_functions/jacobi_elliptic.hpp"
+#include "secular.h"
+#include "tools.h"
+
+namespace secular {
+
+/* 'auto' propagates in closed form whenever the outer orbit is fixed to within test_particle_limit */
+enum class Analytic_mode { off, on, automatic };
+
+Analytic_mode str_to_analytic_mode(std::string const &key) {
+  if (case_insens_equals(key, "off")) {
+    return Analytic_mode::off;
+  } else if (case_insens_equals(key, "on")) {
+    return Analytic_mode::on;
+  } else if (case_insens_equals(key, "auto")) {
+    return Analytic_mode::automatic;
+  } else {
+    throw ReturnFlag::input_err;
+  }
+}
+
+/* L_in / L_out below which the back reaction on the outer orbit is neglected in 'auto' mode */
+constexpr double test_particle_limit = 1e-5;
+
+/* the quadrupole DA problem and nothing else: the only configuration with a closed-form solution */
+inline bool analytic_physics(Controller const &ctrl) {
+  return ctrl.ave_method == LK_method::DA && !ctrl.hybrid && ctrl.Quad && !ctrl.Oct && !ctrl.GR_in && !ctrl.GR_out &&
+         !ctrl.GW_in && !ctrl.GW_out && ctrl.spin_num() == 0 && ctrl.LL == deS::off;
+}
+
+/*
+ * Closed-form solution of the quadrupole test-particle Lidov-Kozai problem. With the outer orbit fixed along
+ * n, j = L1 / L_circular and e evolve under H = (j.n)^2 / 2 - 5 (e.n)^2 / 2 + e^2 in tau = 0.75 t / t_LK, which
+ * conserves j.n and H. The component y = e.n then obeys (dy/dtau)^2 = 15 (y^2 - p)(q - y^2): y = sqrt(q) cn(u, k)
+ * for a circulating orbit (p < 0) and sqrt(q) dn(u, k) for a librating one, u = u0 + lambda tau. y gives
+ * |e| and |j|, dy/dtau gives (e x j).n, and the node of j follows from an elliptic integral of the third kind,
+ * which fixes both vectors at any time without stepping.
+ */
+class Quad_LK_propagator {
+ public:
+  template <typename Container>
+  Quad_LK_propagator(SecularConst const &args, Container const &x, double t0)
+      : t0_{t0}, L2_{x.L2x(), x.L2y(), x.L2z()}, e2_{x.e2x(), x.e2y(), x.e2z()} {
+    auto const [e1_sqr, j1_sqr, j1, L1_norm, L_in, a_in] =
+        calc_orbit_args(args.a_in_coef(), x.L1x(), x.L1y(), x.L1z(), x.e1x(), x.e1y(), x.e1z());
+
+    auto const [e2_sqr, j2_sqr, j2, L2_norm, L_out, a_out] =
+        calc_orbit_args(args.a_out_coef(), x.L2x(), x.L2y(), x.L2z(), x.e2x(), x.e2y(), x.e2z());
+
+    L_in_ = L_in;
+
+    coupling_ = L1_norm / L2_norm;
+
+    rate_ = 0.75 / t_k_quad(args.m12(), args.m3(), a_in, a_out * j2);
+
+    set_frame(x.L2x() / L2_norm, x.L2y() / L2_norm, x.L2z() / L2_norm);
+
+    auto const [jX, jY, jz] = to_local(x.L1x() / L_in, x.L1y() / L_in, x.L1z() / L_in);
+
+    auto const [eX, eY, y0] = to_local(x.e1x(), x.e1y(), x.e1z());
+
+    double const w0 = eX * jY - eY * jX;
+
+    jz_ = jz;
+
+    phi0_ = atan2(jY, jX);
+
+    // K = 1 - x - 5 y^2 / 2 with x = |j|^2, taken from e^2 to keep the separatrix region free of cancellation
+    double const K = e1_sqr - 2.5 * y0 * y0;
+
+    a0_ = 1 - K;
+
+    c_ = a0_ - jz * jz;
+
+    // p and q are (a0 - x) / 2.5 at the roots x of 3 x^2 - b x + 5 jz^2, with p q = -4 K c / 15
+    double const b = 3 + 5 * jz * jz + 2 * K;
+
+    double const disc = sqrt(std::max(b * b - 60 * jz * jz, 0.0));
+
+    double const q = (a0_ - 10 * jz * jz / (b + disc)) / 2.5;
+
+    double const p = -4 * K * c_ / (15 * q);
+
+    circulating_ = p < 0;
+
+    amp_ = sqrt(std::max(q, 0.0));
+
+    if (circulating_) {
+      k_ = sqrt(q / (q - p));
+      kp2_ = -p / (q - p);
+      lambda_ = sqrt(15 * (q - p));
+      nu_ = -2.5 * q / (c_ - 2.5 * q);
+    } else {
+      k_ = sqrt((q - p) / q);
+      kp2_ = p / q;
+      lambda_ = sqrt(15 * q);
+      nu_ = -2.5 * q * k_ * k_ / (c_ - 2.5 * q);
+      sigma_ = y0 >= 0 ? 1 : -1;
+    }
+
+    // e = 0, a coplanar orbit, a trajectory into e = 1 or the separatrix itself: left to the integrator
+    valid_ = e1_sqr > 0 && j1_sqr - jz * jz > 1e-14 * j1_sqr && q > 0 && c_ - 2.5 * q > 0 && kp2_ > 1e-10;
+
+    if (!valid_) return;
+
+    K_ = boost::math::ellint_1(k_);
+
+    Pi_ = boost::math::ellint_3(k_, nu_, consts::pi / 2);
+
+    if (circulating_) {
+      double const u = incomplete_F(acos(std::clamp(y0 / amp_, -1.0, 1.0)));
+      u0_ = w0 >= 0 ? u : -u;
+    } else {
+      double const dn = std::clamp(fabs(y0) / amp_, 0.0, 1.0);
+      double const u = boost::math::ellint_1(k_, asin(std::min(sqrt((1 - dn * dn) / (k_ * k_)), 1.0)));
+      u0_ = sigma_ * w0 > 0 ? u : -u;
+    }
+
+    Pi0_ = Pi(u0_);
+  }
+
+  bool valid() const { return valid_; }
+
+  /* L_in / L_out, how far the outer orbit is from being fixed */
+  double coupling() const { return coupling_; }
+
+  /*
+   * The largest e_in between t0 and t. e^2 = 1 - a0 + 5 y^2 / 2 grows with |y|, which peaks at amp for u = 2 m K and
+   * otherwise runs monotonically, so it is amp if such a u lies on the way and the larger end value if none does.
+   */
+  double e_max(double t) const {
+    double const u = u0_ + lambda_ * rate_ * (t - t0_);
+
+    double y_max = amp_;
+
+    if (ceil(std::min(u0_, u) / (2 * K_)) > floor(std::max(u0_, u) / (2 * K_))) {
+      auto const y_at = [&](double v) {
+        auto const [sn, cn, dn] = jacobi(v);
+        return amp_ * (circulating_ ? fabs(cn) : dn);
+      };
+      y_max = std::max(y_at(u0_), y_at(u));
+    }
+    return sqrt(std::max(1 - a0_ + 2.5 * y_max * y_max, 0.0));
+  }
+
+  /* the first time after t at which e_in has an extremum, at u = m K, and whether it is a maximum (m even) */
+  std::pair<double, bool> extremum_after(double t) const {
+    double const speed = lambda_ * rate_;
+
+    double m = floor((u0_ + speed * (t - t0_)) / K_) + 1;
+
+    if (t0_ + (m * K_ - u0_) / speed <= t) m++;
+
+    return {t0_ + (m * K_ - u0_) / speed, fmod(m, 2) == 0};
+  }
+
+  /* the state at time t; the outer orbit is carried along unchanged */
+  template <typename Container>
+  void operator()(double t, Container &x) const {
+    double const tau = rate_ * (t - t0_);
+
+    double const u = u0_ + lambda_ * tau;
+
+    auto const [sn, cn, dn] = jacobi(u);
+
+    double y, dy_du;
+
+    if (circulating_) {
+      y = amp_ * cn;
+      dy_du = -amp_ * sn * dn;
+    } else {
+      y = sigma_ * amp_ * dn;
+      dy_du = -sigma_ * amp_ * k_ * k_ * sn * cn;
+    }
+
+    double const w = -0.5 * lambda_ * dy_du;
+
+    double const J = sqrt(std::max(c_ - 2.5 * y * y, 0.0));
+
+    double const phi = phi0_ + jz_ * tau - 2 * jz_ * c_ * (Pi(u) - Pi0_) / (lambda_ * (c_ - 2.5 * amp_ * amp_));
+
+    double const cos_phi = cos(phi), sin_phi = sin(phi);
+
+    double const alpha = -y * jz_ / J, beta = -w / J;
+
+    auto const [jx, jy, jz] = to_global(J * cos_phi, J * sin_phi, jz_);
+
+    auto const [ex, ey, ez] = to_global(alpha * cos_phi - beta * sin_phi, alpha * sin_phi + beta * cos_phi, y);
+
+    x.set_L1(L_in_ * jx, L_in_ * jy, L_in_ * jz);
+
+    x.set_e1(ex, ey, ez);
+
+    x.set_L2(UNPACK3(L2_));
+
+    x.set_e2(UNPACK3(e2_));
+  }
+
+ private:
+  double t0_;
+  Tup3d L2_;
+  Tup3d e2_;
+  Tup3d X_;
+  Tup3d Y_;
+  Tup3d n_;
+  double L_in_{0};
+  double coupling_{0};
+  double rate_{0};
+  double jz_{0};
+  double a0_{0};
+  double c_{0};
+  double phi0_{0};
+  double amp_{0};
+  double k_{0};
+  double kp2_{0};
+  double lambda_{0};
+  double nu_{0};
+  double sigma_{1};
+  double K_{0};
+  double Pi_{0};
+  double u0_{0};
+  double Pi0_{0};
+  bool circulating_{false};
+  bool valid_{false};
+
+  void set_frame(double nx, double ny, double nz) {
+    n_ = std::make_tuple(nx, ny, nz);
+    auto const [Xx, Xy, Xz] = fabs(nz) < 0.9 ? cross(0, 0, 1, nx, ny, nz) : cross(1, 0, 0, nx, ny, nz);
+    double const X = norm(Xx, Xy, Xz);
+    X_ = std::make_tuple(Xx / X, Xy / X, Xz / X);
+    Y_ = cross(n_, X_);
+  }
+
+  Tup3d to_local(double x, double y, double z) const {
+    return std::make_tuple(dot(x, y, z, UNPACK3(X_)), dot(x, y, z, UNPACK3(Y_)), dot(x, y, z, UNPACK3(n_)));
+  }
+
+  Tup3d to_global(double a, double b, double c) const {
+    auto const [Xx, Xy, Xz] = X_;
+    auto const [Yx, Yy, Yz] = Y_;
+    auto const [nx, ny, nz] = n_;
+    return std::make_tuple(a * Xx + b * Yx + c * nx, a * Xy + b * Yy + c * ny, a * Xz + b * Yz + c * nz);
+  }
+
+  /* F(phi, k) for phi in [0, pi] */
+  double incomplete_F(double phi) const {
+    if (phi <= consts::pi / 2) {
+      return boost::math::ellint_1(k_, phi);
+    } else {
+      return 2 * K_ - boost::math::ellint_1(k_, consts::pi - phi);
+    }
+  }
+
+  /* u = 2 m K + r with r in [-K, K], where sn, cn and the amplitude are well conditioned */
+  std::tuple<double, double> reduce(double u) const {
+    double const m = std::round(u / (2 * K_));
+    return std::make_tuple(m, u - 2 * m * K_);
+  }
+
+  std::tuple<double, double, double> jacobi(double u) const {
+    auto const [m, r] = reduce(u);
+    double cn, dn;
+    double sn = boost::math::jacobi_elliptic(k_, r, &cn, &dn);
+    // dn from the complementary modulus; the one of jacobi_elliptic loses digits around u = K for k -> 1
+    dn = sqrt(kp2_ + k_ * k_ * cn * cn);
+    if (std::fmod(m, 2) != 0) {
+      sn = -sn;
+      cn = -cn;
+    }
+    return std::make_tuple(sn, cn, dn);
+  }
+
+  /* Pi(nu; am(u), k), continued over the whole real line */
+  double Pi(double u) const {
+    auto const [m, r] = reduce(u);
+    double const am = asin(std::clamp(boost::math::jacobi_sn(k_, r), -1.0, 1.0));
+    double const part = boost::math::ellint_3(k_, nu_, fabs(am));
+    return 2 * m * Pi_ + (am < 0 ? -part : part);
+  }
+};
+
+}  // namespace secular
+#endif
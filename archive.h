@@ -0,0 +1,202 @@
+#ifndef SECULAR_ARCHIVE_H
+#define SECULAR_ARCHIVE_H
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "observer.h"
+#include "tools.h"
+
+namespace secular {
+
+std::string to_string(ReturnFlag flag) {
+  switch (flag) {
+    case ReturnFlag::finish:
+      return "finish";
+    case ReturnFlag::max_iter:
+      return "max_iter";
+    case ReturnFlag::interrupt:
+      return "interrupt";
+    case ReturnFlag::event:
+      return "event";
+    case ReturnFlag::quiescent:
+      return "quiescent";
+    default:
+      return "input_err";
+  }
+}
+
+/*
+ * All trajectories of a run packed into one append-only file per worker thread instead of one file per task.
+ * A worker buffers the trajectory of the task in flight and appends it in one piece once the task returns. The
+ * offset, length, return flag and final state of every trajectory go to archive_<n>.idx next to its archive
+ * and, sorted by task id over all archives, to archive_index.txt at the end of the run. Each archived
+ * trajectory is byte-for-byte what the per-task file would have held, so a binary one is read back with
+ * Trajectory_reader(archive, offset, length).
+ *
+ * A resumed run keeps the entries of all existing archive_<n>.idx files and appends to the archives, cut back
+ * to the end of their last indexed trajectory; an archive without a readable index is an error rather than
+ * emptied. A task extended by 'continue' is archived once per run, and archive_index.txt numbers these segments
+ * of a task from 0 in the order of their final times: its trajectory is their concatenation.
+ */
+class Task_archive {
+ public:
+  Task_archive(std::string const &work_dir, size_t worker_num, Output_type type, bool resume = false)
+      : work_dir_{work_dir} {
+    std::string const suffix = type == Output_type::binary ? ".bin" : ".txt";
+
+    std::unordered_map<std::string, size_t> ends;
+
+    std::unordered_set<std::string> indexed;
+
+    if (resume) {
+      load_entries(ends, indexed);
+    }
+
+    for (size_t i = 0; i < worker_num; ++i) {
+      auto file = std::make_unique<File>();
+      std::string const stem = work_dir + "archive_" + std::to_string(i);
+      file->name = "archive_" + std::to_string(i) + suffix;
+
+      if (resume) {
+        file->offset = ends[file->name];
+        if (std::filesystem::exists(stem + suffix)) {
+          auto const size = std::filesystem::file_size(stem + suffix);
+          if ((size > 0 && indexed.count(stem + ".idx") == 0) || size < file->offset) {
+            throw std::runtime_error(stem + suffix + " and its index " + stem + ".idx disagree; not resuming over it");
+          }
+          std::filesystem::resize_file(stem + suffix, file->offset);
+        }
+        file->out.open(stem + suffix, std::fstream::out | std::fstream::app | std::fstream::binary);
+        file->idx.open(stem + ".idx", std::fstream::out | std::fstream::app);
+      } else {
+        file->out.open(stem + suffix, std::fstream::out | std::fstream::binary);
+        file->idx.open(stem + ".idx", std::fstream::out);
+      }
+      file->idx << std::setprecision(12);
+      files_.emplace_back(std::move(file));
+    }
+  }
+
+  /* called by the owner of `worker` only; the trajectory buffer is consumed */
+  template <typename Container>
+  void append(size_t worker, size_t task_id, std::stringstream &trajectory, ReturnFlag flag, double time,
+              Container const &data) {
+    File &file = *files_[worker];
+
+    std::string const bytes = trajectory.str();
+
+    trajectory.str("");
+    trajectory.clear();
+
+    file.out.write(bytes.data(), bytes.size());
+    file.out.flush();
+
+    std::ostringstream row;
+    row << std::setprecision(12) << task_id << ' ' << file.name << ' ' << file.offset << ' ' << bytes.size() << ' '
+        << to_string(flag) << ' ' << time;
+    for (auto x : data) {
+      row << ' ' << x;
+    }
+
+    file.idx << row.str() << "\r\n";
+    file.idx.flush();
+
+    file.entries.emplace_back(Entry{task_id, time, row.str()});
+
+    file.offset += bytes.size();
+  }
+
+  void write_index() {
+    std::vector<Entry const *> entries;
+
+    for (auto const &entry : previous_) {
+      entries.emplace_back(&entry);
+    }
+
+    for (auto &file : files_) {
+      file->out.close();
+      file->idx.close();
+      for (auto const &entry : file->entries) {
+        entries.emplace_back(&entry);
+      }
+    }
+
+    std::stable_sort(entries.begin(), entries.end(), [](auto a, auto b) {
+      return a->task_id < b->task_id || (a->task_id == b->task_id && a->time < b->time);
+    });
+
+    std::fstream index{work_dir_ + "archive_index.txt", std::fstream::out};
+
+    index << "#task_id segment archive offset length flag t state\r\n";
+
+    size_t segment = 0;
+
+    for (size_t k = 0; k < entries.size(); ++k) {
+      segment = k > 0 && entries[k]->task_id == entries[k - 1]->task_id ? segment + 1 : 0;
+
+      auto const &row = entries[k]->row;
+
+      auto const gap = row.find(' ');
+
+      index << row.substr(0, gap) << ' ' << segment << row.substr(gap) << "\r\n";
+    }
+  }
+
+ private:
+  struct Entry {
+    size_t task_id;
+    double time;
+    std::string row;
+  };
+
+  struct File {
+    std::string name;
+    std::fstream out;
+    std::fstream idx;
+    size_t offset{0};
+    std::vector<Entry> entries;
+  };
+
+  std::string work_dir_;
+  std::vector<Entry> previous_;
+  std::vector<std::unique_ptr<File>> files_;
+
+  /* the entries of every readable archive_<n>.idx, whose paths go to indexed */
+  void load_entries(std::unordered_map<std::string, size_t> &ends, std::unordered_set<std::string> &indexed) {
+    for (auto const &path : std::filesystem::directory_iterator(work_dir_)) {
+      if (path.path().extension() != ".idx") continue;
+
+      std::ifstream idx{path.path()};
+
+      if (!idx) continue;
+
+      indexed.insert(work_dir_ + path.path().filename().string());
+
+      for (std::string row; std::getline(idx, row);) {
+        if (!row.empty() && row.back() == '\r') row.pop_back();
+
+        std::istringstream is{row};
+        size_t task_id, offset, length;
+        std::string name, flag;
+        double time;
+        if (!(is >> task_id >> name >> offset >> length >> flag >> time)) continue;
+
+        ends[name] = std::max(ends[name], offset + length);
+        previous_.emplace_back(Entry{task_id, time, row});
+      }
+    }
+  }
+};
+
+}  // namespace secular
+#endif
@@ -0,0 +1,527 @@
+#ifndef SECULAR_BATCH_H
+#define SECULAR_BATCH_H
+
+#include <array>
+#include <cmath>
+#include <limits>
+
+#include "secular.h"
+#include "stepper.h"
+#include "tools.h"
+
+namespace secular {
+
+#if defined(__AVX512F__)
+constexpr size_t simd_lanes = 8;
+#else
+constexpr size_t simd_lanes = 4;
+#endif
+
+/*
+ * Structure-of-arrays block of Lanes independent states: (*this)[i][l] is component i of lane l, so every
+ * component is contiguous across the lanes and the lane loops map onto the vector registers.
+ */
+template <typename Container, size_t Lanes>
+class BatchArray : public std::array<std::array<double, Lanes>, Container::dim> {
+ public:
+  static constexpr size_t s_num{Container::s_num};
+
+  static constexpr size_t lanes{Lanes};
+
+  Container extract(size_t lane) const {
+    Container c;
+    for (size_t i = 0; i < Container::dim; ++i) {
+      c[i] = (*this)[i][lane];
+    }
+    return c;
+  }
+
+  void insert(size_t lane, Container const &c) {
+    for (size_t i = 0; i < Container::dim; ++i) {
+      (*this)[i][lane] = c[i];
+    }
+  }
+};
+
+/*
+ * One lane of a BatchArray seen through the SecularArray accessors, so the physics kernels in LK.h,
+ * deSitter.h and relativistic.h run on the batch unchanged.
+ */
+template <typename Batch>
+class LaneRef {
+ public:
+  static constexpr size_t s_num{Batch::s_num};
+
+  LaneRef(Batch &batch, size_t lane) : batch_{&batch}, lane_{lane} {}
+
+  READ_GETTER(double, L1x, at(0));
+
+  READ_GETTER(double, L1y, at(1));
+
+  READ_GETTER(double, L1z, at(2));
+
+  READ_GETTER(double, e1x, at(3));
+
+  READ_GETTER(double, e1y, at(4));
+
+  READ_GETTER(double, e1z, at(5));
+
+  READ_GETTER(double, L2x, at(6));
+
+  READ_GETTER(double, L2y, at(7));
+
+  READ_GETTER(double, L2z, at(8));
+
+  READ_GETTER(double, e2x, at(9));
+
+  READ_GETTER(double, e2y, at(10));
+
+  READ_GETTER(double, e2z, at(11));
+
+  READ_GETTER(double, rx, at(6));
+
+  READ_GETTER(double, ry, at(7));
+
+  READ_GETTER(double, rz, at(8));
+
+  READ_GETTER(double, vx, at(9));
+
+  READ_GETTER(double, vy, at(10));
+
+  READ_GETTER(double, vz, at(11));
+
+  VEC3_GETTER(L1, at(0), at(1), at(2));
+
+  VEC3_GETTER(e1, at(3), at(4), at(5));
+
+  VEC3_GETTER(L2, at(6), at(7), at(8));
+
+  VEC3_GETTER(e2, at(9), at(10), at(11));
+
+  VEC3_GETTER(r, at(6), at(7), at(8));
+
+  VEC3_GETTER(v, at(9), at(10), at(11));
+
+  STD_3WAY_SETTER(L1, at(0), at(1), at(2));
+
+  STD_3WAY_SETTER(e1, at(3), at(4), at(5));
+
+  STD_3WAY_SETTER(L2, at(6), at(7), at(8));
+
+  STD_3WAY_SETTER(e2, at(9), at(10), at(11));
+
+  STD_3WAY_SETTER(r, at(6), at(7), at(8));
+
+  STD_3WAY_SETTER(v, at(9), at(10), at(11));
+
+  OPT_READ_GETTER(s_num >= 2, double, S1x, at(12));
+
+  OPT_READ_GETTER(s_num >= 2, double, S1y, at(13));
+
+  OPT_READ_GETTER(s_num >= 2, double, S1z, at(14));
+
+  OPT_READ_GETTER(s_num >= 2, double, S2x, at(15));
+
+  OPT_READ_GETTER(s_num >= 2, double, S2y, at(16));
+
+  OPT_READ_GETTER(s_num >= 2, double, S2z, at(17));
+
+  OPT_READ_GETTER(s_num >= 3, double, S3x, at(18));
+
+  OPT_READ_GETTER(s_num >= 3, double, S3y, at(19));
+
+  OPT_READ_GETTER(s_num >= 3, double, S3z, at(20));
+
+  OPT_VEC3_GETTER(s_num >= 2, S1, at(12), at(13), at(14));
+
+  OPT_VEC3_GETTER(s_num >= 2, S2, at(15), at(16), at(17));
+
+  OPT_VEC3_GETTER(s_num >= 3, S3, at(18), at(19), at(20));
+
+  OPT_3WAY_SETTER(s_num >= 2, S1, at(12), at(13), at(14));
+
+  OPT_3WAY_SETTER(s_num >= 2, S2, at(15), at(16), at(17));
+
+  OPT_3WAY_SETTER(s_num >= 3, S3, at(18), at(19), at(20));
+
+ private:
+  Batch *batch_;
+  size_t lane_;
+
+  inline double &at(size_t i) const { return (*batch_)[i][lane_]; }
+};
+
+#define BATCH_CONST_FIELDS(FIELD)                                                                             \
+  FIELD(0, m1)                                                                                                \
+  FIELD(1, m2)                                                                                                \
+  FIELD(2, m3)                                                                                                \
+  FIELD(3, m12)                                                                                               \
+  FIELD(4, m_tot)                                                                                             \
+  FIELD(5, mu_in)                                                                                             \
+  FIELD(6, mu_out)                                                                                            \
+  FIELD(7, a_in_coef)                                                                                         \
+  FIELD(8, a_out_coef)                                                                                        \
+  FIELD(9, SA_acc_coef)                                                                                       \
+  FIELD(10, GR_in_coef)                                                                                       \
+  FIELD(11, GW_L_in_coef)                                                                                     \
+  FIELD(12, GW_e_in_coef)                                                                                     \
+  FIELD(13, GR_out_coef)                                                                                      \
+  FIELD(14, GW_L_out_coef)                                                                                    \
+  FIELD(15, GW_e_out_coef)                                                                                    \
+  FIELD(16, LL)                                                                                               \
+  FIELD(17, S1L1)                                                                                             \
+  FIELD(18, S1L2)                                                                                             \
+  FIELD(19, S2L1)                                                                                             \
+  FIELD(20, S2L2)                                                                                             \
+  FIELD(21, S3L1)                                                                                             \
+  FIELD(22, S3L2)                                                                                             \
+  FIELD(23, S1S2)                                                                                             \
+  FIELD(24, S1S3)                                                                                             \
+  FIELD(25, S2S3)
+
+/*
+ * The SecularConst coefficients of every lane, transposed like BatchArray. Reading them through an array of
+ * SecularConst would be a 30-double strided gather, which the vectorizer refuses.
+ */
+template <size_t Lanes>
+class BatchConst : public std::array<std::array<double, Lanes>, 26> {
+ public:
+  void insert(size_t lane, SecularConst const &c) {
+#define INSERT_FIELD(I, NAME) (*this)[I][lane] = c.NAME();
+    BATCH_CONST_FIELDS(INSERT_FIELD)
+#undef INSERT_FIELD
+  }
+};
+
+template <size_t Lanes>
+class LaneConst {
+ public:
+  LaneConst(BatchConst<Lanes> const &batch, size_t lane) : batch_{&batch}, lane_{lane} {}
+
+#define LANE_FIELD(I, NAME) READ_GETTER(double, NAME, at(I))
+  BATCH_CONST_FIELDS(LANE_FIELD)
+#undef LANE_FIELD
+
+ private:
+  BatchConst<Lanes> const *batch_;
+  size_t lane_;
+
+  inline double const &at(size_t i) const { return (*batch_)[i][lane_]; }
+};
+
+template <typename Ctrl, size_t Lanes>
+struct Batch_dispatch {
+  using Container = typename Ctrl::Container;
+
+  using Batch = BatchArray<Container, Lanes>;
+
+  using Lane = LaneRef<Batch>;
+
+  Batch_dispatch(Ctrl const &_ctrl, BatchConst<Lanes> const &_args)
+      : ctrl{&_ctrl}, args{&_args}, spin_on_{is_Lin_needed(_ctrl) || is_Lout_needed(_ctrl)} {}
+
+  void operator()(Batch const &x, Batch &dxdt) {
+    for (auto &c : dxdt) {
+      c.fill(0);
+    }
+
+    // the kernels only call the const getters on the state, the cast just lets x and dxdt share the view type.
+    auto &in = const_cast<Batch &>(x);
+
+    // the orbits of every lane first, then one lane loop per physics term, so the run-time switches stay outside
+    // the vectorized loops.
+#pragma GCC ivdep
+    for (size_t l = 0; l < Lanes; ++l) {
+      orbits_[l] = Orbit_context{LaneConst<Lanes>{*args, l}, Lane{in, l}, ctrl->ave_method == LK_method::DA};
+    }
+
+#pragma GCC ivdep
+    for (size_t l = 0; l < Lanes; ++l) {
+      Lane dvar{dxdt, l};
+      Lidov_Kozai(*ctrl, LaneConst<Lanes>{*args, l}, Lane{in, l}, dvar, orbits_[l]);
+    }
+
+    if (spin_on_) {
+#pragma GCC ivdep
+      for (size_t l = 0; l < Lanes; ++l) {
+        Lane dvar{dxdt, l};
+        spin_orbit_coupling(*ctrl, LaneConst<Lanes>{*args, l}, Lane{in, l}, dvar, orbits_[l]);
+      }
+    }
+
+    if (ctrl->GR_in || ctrl->GR_out) {
+#pragma GCC ivdep
+      for (size_t l = 0; l < Lanes; ++l) {
+        Lane dvar{dxdt, l};
+        GR_precession(*ctrl, LaneConst<Lanes>{*args, l}, Lane{in, l}, dvar, orbits_[l]);
+      }
+    }
+
+    if (ctrl->GW_in) {
+#pragma GCC ivdep
+      for (size_t l = 0; l < Lanes; ++l) {
+        Lane dvar{dxdt, l};
+        GW_radiation(*ctrl, LaneConst<Lanes>{*args, l}, Lane{in, l}, dvar, orbits_[l]);
+      }
+    }
+  }
+
+  Ctrl const *ctrl;
+  BatchConst<Lanes> const *args;
+
+ private:
+  bool spin_on_;
+  std::array<Orbit_context, Lanes> orbits_;
+};
+
+/*
+ * Dormand-Prince 5(4) integrator that advances Lanes systems in lockstep. Every lane carries its own time
+ * and step size; a rejected trial only rolls back the lanes whose error exceeds the tolerance, the others
+ * keep the new state. Bulirsch-Stoer is not used here because its per-lane extrapolation order breaks the
+ * lockstep. Inactive lanes are still evaluated but never advanced. The step size control takes the RK_* tuning and
+ * max_dt of the stepper config, whatever 'stepper' names.
+ */
+template <typename Ctrl, size_t Lanes>
+class Batch_stepper {
+ public:
+  using Container = typename Ctrl::Container;
+
+  using Batch = BatchArray<Container, Lanes>;
+
+  using LaneMask = std::array<bool, Lanes>;
+
+  Batch_stepper(Ctrl const &ctrl, double atol, double rtol, Stepper_config const &cfg = Stepper_config{})
+      : ctrl_{ctrl},
+        func_{ctrl_, args_},
+        atol_{atol},
+        rtol_{rtol},
+        safety_{cfg.RK_safety},
+        max_grow_{cfg.RK_max_grow},
+        max_shrink_{cfg.RK_max_shrink},
+        max_dt_{cfg.max_dt} {
+    for (auto &c : x_) {
+      c.fill(0);
+    }
+    active_.fill(false);
+    fresh_.fill(false);
+    accepted_.fill(false);
+    time_.fill(0);
+    dt_.fill(0);
+    h_.fill(0);
+    rejects_.fill(0);
+    rhs_calls_.fill(0);
+  }
+
+  READ_GETTER(LaneMask, active, active_);
+
+  READ_GETTER(LaneMask, accepted, accepted_);
+
+  double time(size_t lane) const { return time_[lane]; }
+
+  double step_size(size_t lane) const { return dt_[lane]; }
+
+  size_t rejects(size_t lane) const { return rejects_[lane]; }
+
+  /* true once the step of the lane has shrunk below the resolution of its time: it cannot go on */
+  bool stalled(size_t lane) const { return !(time_[lane] + dt_[lane] > time_[lane]); }
+
+  /* RHS evaluations made on the lane since its task was loaded */
+  size_t rhs_calls(size_t lane) const { return rhs_calls_[lane]; }
+
+  Container state(size_t lane) const { return x_.extract(lane); }
+
+  bool any_active() const {
+    for (auto a : active_) {
+      if (a) return true;
+    }
+    return false;
+  }
+
+  void load(size_t lane, Container const &init, SecularConst const &args, double t0, double dt0) {
+    x_.insert(lane, init);
+    args_.insert(lane, args);
+    time_[lane] = t0;
+    dt_[lane] = dt0;
+    rejects_[lane] = 0;
+    rhs_calls_[lane] = 0;
+    active_[lane] = true;
+    fresh_[lane] = true;
+  }
+
+  void deactivate(size_t lane) { active_[lane] = false; }
+
+  /* move an active lane to x between two steps; its first stage is evaluated anew */
+  void move(size_t lane, Container const &x) {
+    x_.insert(lane, x);
+    fresh_[lane] = true;
+  }
+
+  /* one trial step on every active lane; accepted() tells which lanes moved forward */
+  void try_step() {
+    refresh_first_stage();
+
+    stage(x1_, {a21});
+    func_(x1_, k2_);
+
+    stage(x1_, {a31, a32});
+    func_(x1_, k3_);
+
+    stage(x1_, {a41, a42, a43});
+    func_(x1_, k4_);
+
+    stage(x1_, {a51, a52, a53, a54});
+    func_(x1_, k5_);
+
+    stage(x1_, {a61, a62, a63, a64, a65});
+    func_(x1_, k6_);
+
+    stage(x1_, {b1, 0, b3, b4, b5, b6});
+    func_(x1_, k7_);
+
+    std::array<double, Lanes> err;
+    err.fill(0);
+
+    for (size_t i = 0; i < Container::dim; ++i) {
+      for (size_t l = 0; l < Lanes; ++l) {
+        double const e = dt_[l] * (e1 * k1_[i][l] + e3 * k3_[i][l] + e4 * k4_[i][l] + e5 * k5_[i][l] +
+                                   e6 * k6_[i][l] + e7 * k7_[i][l]);
+        double const scale = atol_ + rtol_ * std::max(fabs(x_[i][l]), fabs(x1_[i][l]));
+        double const r = fabs(e) / scale;
+        // a stage that went NaN or Inf rejects the step (std::max would drop a NaN)
+        if (!(r <= err[l])) {
+          err[l] = std::isfinite(r) ? r : std::numeric_limits<double>::infinity();
+        }
+      }
+    }
+
+    for (size_t l = 0; l < Lanes; ++l) {
+      rhs_calls_[l] += active_[l] ? 6 : 0;
+      accepted_[l] = active_[l] && err[l] <= 1.0;
+      double const fac = err[l] > 0 ? safety_ * pow(err[l], -0.2) : max_grow_;
+      if (accepted_[l]) {
+        h_[l] = dt_[l];
+        time_[l] += dt_[l];
+        dt_[l] *= std::min(max_grow_, std::max(max_shrink_, fac));
+        rejects_[l] = 0;
+      } else if (active_[l]) {
+        dt_[l] *= std::min(1.0, std::max(max_shrink_, fac));
+        rejects_[l]++;
+      }
+      if (max_dt_ > 0) {
+        dt_[l] = std::min(dt_[l], max_dt_);
+      }
+    }
+
+    // FSAL: the last stage of an accepted lane is the first stage of its next step. The start of the step is
+    // kept for the dense output.
+    for (size_t i = 0; i < Container::dim; ++i) {
+      for (size_t l = 0; l < Lanes; ++l) {
+        if (accepted_[l]) {
+          x0_[i][l] = x_[i][l];
+          k0_[i][l] = k1_[i][l];
+          x_[i][l] = x1_[i][l];
+          k1_[i][l] = k7_[i][l];
+        }
+      }
+    }
+  }
+
+  /*
+   * State of a lane at t inside its last accepted step, from the 4th-order continuous extension of
+   * Dormand-Prince 5(4) (Hairer, Norsett & Wanner, Solving ODEs I, II.6). Valid until the next try_step.
+   */
+  void interpolate(size_t lane, double t, Container &out) const {
+    double const h = h_[lane];
+    double const theta = (t - (time_[lane] - h)) / h;
+    double const theta1 = 1 - theta;
+
+    for (size_t i = 0; i < Container::dim; ++i) {
+      double const y0 = x0_[i][lane];
+      double const diff = x_[i][lane] - y0;
+      double const bspl = h * k0_[i][lane] - diff;
+      double const rest = diff - h * k7_[i][lane] - bspl;
+      double const d = h * (d1 * k0_[i][lane] + d3 * k3_[i][lane] + d4 * k4_[i][lane] + d5 * k5_[i][lane] +
+                            d6 * k6_[i][lane] + d7 * k7_[i][lane]);
+      out[i] = y0 + theta * (diff + theta1 * (bspl + theta * (rest + theta1 * d)));
+    }
+  }
+
+ private:
+  static constexpr double a21{1.0 / 5};
+  static constexpr double a31{3.0 / 40}, a32{9.0 / 40};
+  static constexpr double a41{44.0 / 45}, a42{-56.0 / 15}, a43{32.0 / 9};
+  static constexpr double a51{19372.0 / 6561}, a52{-25360.0 / 2187}, a53{64448.0 / 6561}, a54{-212.0 / 729};
+  static constexpr double a61{9017.0 / 3168}, a62{-355.0 / 33}, a63{46732.0 / 5247}, a64{49.0 / 176},
+      a65{-5103.0 / 18656};
+  static constexpr double b1{35.0 / 384}, b3{500.0 / 1113}, b4{125.0 / 192}, b5{-2187.0 / 6784}, b6{11.0 / 84};
+  static constexpr double e1{71.0 / 57600}, e3{-71.0 / 16695}, e4{71.0 / 1920}, e5{-17253.0 / 339200},
+      e6{22.0 / 525}, e7{-1.0 / 40};
+  static constexpr double d1{-12715105075.0 / 11282082432}, d3{87487479700.0 / 32700410799},
+      d4{-10690763975.0 / 1880347072}, d5{701980252875.0 / 199316789632}, d6{-1453857185.0 / 822651844},
+      d7{69997945.0 / 29380423};
+
+  Ctrl ctrl_;
+  BatchConst<Lanes> args_;
+  Batch_dispatch<Ctrl, Lanes> func_;
+  Batch x_, x1_, k1_, k2_, k3_, k4_, k5_, k6_, k7_;
+  Batch x0_, k0_;
+  std::array<double, Lanes> time_;
+  std::array<double, Lanes> dt_;
+  std::array<double, Lanes> h_;
+  std::array<size_t, Lanes> rejects_;
+  std::array<size_t, Lanes> rhs_calls_;
+  LaneMask active_;
+  LaneMask fresh_;
+  LaneMask accepted_;
+  double atol_;
+  double rtol_;
+  double safety_;
+  double max_grow_;
+  double max_shrink_;
+  double max_dt_;
+
+  /* x1 = x + dt * sum_j a_j * k_j, for the stages given so far */
+  void stage(Batch &out, std::initializer_list<double> coef) {
+    Batch const *k[6] = {&k1_, &k2_, &k3_, &k4_, &k5_, &k6_};
+    for (size_t i = 0; i < Container::dim; ++i) {
+      for (size_t l = 0; l < Lanes; ++l) {
+        out[i][l] = x_[i][l];
+      }
+      size_t j = 0;
+      for (double a : coef) {
+        if (a != 0) {
+          for (size_t l = 0; l < Lanes; ++l) {
+            out[i][l] += dt_[l] * a * (*k[j])[i][l];
+          }
+        }
+        ++j;
+      }
+    }
+  }
+
+  /* lanes that were just (re)loaded need a fresh first stage, the others reuse the FSAL stage */
+  void refresh_first_stage() {
+    bool any_fresh = false;
+    for (auto f : fresh_) {
+      any_fresh |= f;
+    }
+
+    if (any_fresh) {
+      func_(x_, k7_);
+      for (size_t i = 0; i < Container::dim; ++i) {
+        for (size_t l = 0; l < Lanes; ++l) {
+          if (fresh_[l]) {
+            k1_[i][l] = k7_[i][l];
+          }
+        }
+      }
+      for (size_t l = 0; l < Lanes; ++l) {
+        rhs_calls_[l] += fresh_[l] ? 1 : 0;
+      }
+      fresh_.fill(false);
+    }
+  }
+};
+
+}  // namespace secular
+#endif
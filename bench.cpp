@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "secular.h"
+
+/*
+ * Timing of the RHS kernels for every combination of the compile-time switches (averaging, octupole, GR_in,
+ * GW_in, spins). Each kernel is evaluated on a fixed set of random valid states; a repetition is as many passes
+ * over the set as fill min_rep_time, and the spread over the repetitions is reported next to the mean, so a
+ * change of a kernel can be told from noise.
+ *
+ * usage: bench [repetitions] [states]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double min_rep_time = 2e-3;
+
+struct Timing {
+  double mean;
+  double sd;
+};
+
+/* ns per call of eval(i), i running over [0, states) */
+template <typename Eval>
+Timing time_kernel(size_t states, size_t reps, Eval &&eval) {
+  auto pass = [&](size_t passes) {
+    auto const start = Clock::now();
+    for (size_t p = 0; p < passes; ++p) {
+      for (size_t i = 0; i < states; ++i) {
+        eval(i);
+      }
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  };
+
+  size_t passes = 1;
+
+  for (; pass(passes) < min_rep_time; passes *= 2) {
+  }
+
+  std::vector<double> ns(reps);
+
+  for (auto &t : ns) {
+    t = pass(passes) * 1e9 / (passes * states);
+  }
+
+  double mean = 0, var = 0;
+
+  for (auto t : ns) mean += t;
+
+  mean /= reps;
+
+  for (auto t : ns) var += (t - mean) * (t - mean);
+
+  var /= reps > 1 ? reps - 1 : 1;
+
+  return Timing{mean, sqrt(var)};
+}
+
+/* the 13 orbital columns of an input row (masses through mean anomaly) and three random spins */
+std::vector<double> random_row(std::mt19937_64 &gen) {
+  std::uniform_real_distribution<double> u{0, 1};
+
+  double const m1 = 1 + 49 * u(gen), m2 = 1 + 49 * u(gen), m3 = 1 + 999 * u(gen);
+
+  double const a_in = pow(10, 2 * u(gen));
+
+  double const a_out = a_in * pow(10, 1 + 2 * u(gen));
+
+  std::vector<double> row{m1, m2, m3, a_in, a_out, 0.95 * u(gen), 0.9 * u(gen)};
+
+  row.insert(row.end(), {360 * u(gen), 360 * u(gen), 360 * u(gen), 180 * u(gen), 180 * u(gen), 360 * u(gen)});
+
+  for (size_t s = 0; s < 3; ++s) {
+    double const cos_t = 2 * u(gen) - 1, phi = 2 * secular::consts::pi * u(gen), S = u(gen);
+    double const sin_t = sqrt(1 - cos_t * cos_t);
+    row.insert(row.end(), {S * sin_t * cos(phi), S * sin_t * sin(phi), S * cos_t});
+  }
+  return row;
+}
+
+std::string label(secular::Controller const &ctrl) {
+  return std::string{ctrl.ave_method == secular::LK_method::DA ? "DA" : "SA"} + (ctrl.Oct ? " oct " : " quad") +
+         (ctrl.GR_in ? " GR_in" : "      ") + (ctrl.GW_in ? " GW_in" : "      ") + " S" +
+         std::to_string(ctrl.spin_num());
+}
+
+void report(std::string const &config, std::string const &kernel, Timing const &t) {
+  std::cout << std::left << std::setw(30) << config << std::setw(22) << kernel << std::right << std::fixed
+            << std::setprecision(1) << std::setw(10) << t.mean << std::setw(10) << t.sd << std::setw(8)
+            << 100 * t.sd / t.mean << std::scientific << std::setprecision(3) << std::setw(14) << 1e9 / t.mean
+            << '\n';
+}
+
+template <typename Ctrl>
+void bench_config(Ctrl const &static_ctrl, secular::Controller const &ctrl, size_t states, size_t reps,
+                  double &sink) {
+  using Container = typename Ctrl::Container;
+
+  std::mt19937_64 gen{20200101};
+
+  std::vector<secular::SecularConst> args(states);
+
+  std::vector<Container> x(states);
+
+  for (size_t i = 0; i < states; ++i) {
+    auto const row = random_row(gen);
+    args[i] = secular::SecularConst{row[0], row[1], row[2]};
+    initialize_orbit_args(ctrl.ave_method, x[i], row.begin());
+  }
+
+  Container dxdt;
+
+  auto run = [&](std::string const &kernel, auto &&rhs) {
+    auto const t = time_kernel(states, reps, [&](size_t i) {
+      std::fill(dxdt.begin(), dxdt.end(), 0);
+      rhs(args[i], x[i], dxdt);
+      sink += dxdt[0];
+    });
+    report(label(ctrl), kernel, t);
+  };
+
+  // a kernel on its own derives the orbits it needs, as Dynamic_dispatch does once for all of them
+  bool constexpr DA = Ctrl::ave_method == secular::LK_method::DA;
+
+  auto orbits = [](auto const &a, auto const &v) { return secular::Orbit_context{a, v, DA}; };
+
+  run("Orbit_context", [&](auto const &a, auto const &v, auto &d) { d[0] += orbits(a, v).in.a; });
+
+  if constexpr (DA) {
+    run("double_aved_LK",
+        [&](auto const &a, auto const &v, auto &d) { double_aved_LK(static_ctrl, a, v, d, orbits(a, v)); });
+  } else {
+    run("single_aved_LK",
+        [&](auto const &a, auto const &v, auto &d) { single_aved_LK(static_ctrl, a, v, d, orbits(a, v)); });
+  }
+
+  if constexpr (Ctrl::spin_num != 0) {
+    run("spin_orbit_coupling",
+        [&](auto const &a, auto const &v, auto &d) { spin_orbit_coupling(static_ctrl, a, v, d, orbits(a, v)); });
+  }
+
+  if constexpr (Ctrl::GR_in) {
+    run("GR_precession",
+        [&](auto const &a, auto const &v, auto &d) { GR_precession(static_ctrl, a, v, d, orbits(a, v)); });
+  }
+
+  if constexpr (Ctrl::GW_in) {
+    run("GW_radiation",
+        [&](auto const &a, auto const &v, auto &d) { GW_radiation(static_ctrl, a, v, d, orbits(a, v)); });
+  }
+
+  run("Dynamic_dispatch", [&](auto const &a, auto const &v, auto &d) {
+    secular::Dynamic_dispatch<Container, Ctrl>{static_ctrl, a}(v, d, 0);
+  });
+}
+
+int main(int argc, char **argv) {
+  std::ios::sync_with_stdio(false);
+
+  size_t const reps = argc > 1 ? std::stoul(argv[1]) : 20;
+
+  size_t const states = argc > 2 ? std::stoul(argv[2]) : 1024;
+
+  double sink = 0;
+
+  std::cout << std::left << std::setw(30) << "#config" << std::setw(22) << "kernel" << std::right << std::setw(10)
+            << "ns/eval" << std::setw(10) << "sd[ns]" << std::setw(8) << "sd[%]" << std::setw(14) << "evals/s"
+            << '\n';
+
+  for (auto method : {secular::LK_method::DA, secular::LK_method::SA}) {
+    for (size_t flags = 0; flags < 8; ++flags) {
+      for (size_t spin : {0, 2, 3}) {
+        secular::Controller ctrl;
+
+        ctrl.ave_method = method;
+        ctrl.Oct = flags & 1;
+        ctrl.GR_in = flags & 2;
+        ctrl.GW_in = flags & 4;
+        ctrl.GW_in_ratio = ctrl.GW_in ? 1e-3 : 0;
+
+        if (spin >= 2) {
+          ctrl.Sin_Lin = ctrl.Sin_Lout = ctrl.Sin_Sin = secular::deS::all;
+        }
+
+        if (spin >= 3) {
+          ctrl.Sout_Lin = ctrl.Sout_Lout = ctrl.Sin_Sout = secular::deS::all;
+        }
+
+        secular::static_dispatch(ctrl, [&](auto const &static_ctrl) {
+          bench_config(static_ctrl, ctrl, states, reps, sink);
+        });
+      }
+    }
+    std::cout.flush();
+  }
+
+  // keeps the kernels from being optimized away
+  std::cerr << (std::isfinite(sink) ? "" : "non-finite derivatives\n");
+  return 0;
+}
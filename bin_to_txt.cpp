@@ -0,0 +1,32 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "trajectory_reader.h"
+
+int main(int argc, char **argv) {
+  std::ios::sync_with_stdio(false);
+
+  if (argc != 2 && argc != 4) {
+    std::cout << "usage: " << argv[0] << " secular_<id>.bin\n"
+              << "       " << argv[0] << " archive_<n>.bin offset length\n";
+    return 0;
+  }
+
+  size_t const offset = argc == 4 ? std::stoull(argv[2]) : 0;
+
+  size_t const length = argc == 4 ? std::stoull(argv[3]) : 0;
+
+  secular::Trajectory_reader traj{argv[1], offset, length};
+
+  std::cout << std::setprecision(12);
+
+  for (size_t i = 0; i < traj.size(); ++i) {
+    double const *rec = traj.record(i);
+    std::cout << rec[0];
+    for (size_t j = 1; j < traj.columns(); ++j) {
+      std::cout << ' ' << rec[j];
+    }
+    std::cout << "\r\n";
+  }
+  return 0;
+}
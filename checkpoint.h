@@ -0,0 +1,264 @@
+#ifndef SECULAR_CHECKPOINT_H
+#define SECULAR_CHECKPOINT_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tools.h"
+
+namespace secular {
+
+/* 'resume' continues an interrupted run; 'continue' additionally extends finished tasks to a larger t_end */
+enum class Restart_mode { off, resume, extend };
+
+Restart_mode str_to_restart_mode(std::string const &key) {
+  if (case_insens_equals(key, "off")) {
+    return Restart_mode::off;
+  } else if (case_insens_equals(key, "resume")) {
+    return Restart_mode::resume;
+  } else if (case_insens_equals(key, "continue")) {
+    return Restart_mode::extend;
+  } else {
+    throw ReturnFlag::input_err;
+  }
+}
+
+/*
+ * Everything needed to pick a task up again: the integrator position, the next output time of its
+ * Stream_observer and how many bytes of its trajectory were written when the snapshot was taken. A negative
+ * size means the task restarts from a final state in last_state.txt and appends a fresh trajectory segment. The
+ * stage is the triage stage the snapshot was taken in (1 without triage), 0 for a final state.
+ */
+struct Task_checkpoint {
+  size_t task_id{0};
+  double time{0};
+  double dt{0};
+  double t_out{0};
+  long long traj_size{-1};
+  std::vector<double> state;
+  int stage{0};
+};
+
+/* put a snapshot back into a state container; one taken with a different spin configuration is rejected */
+template <typename Container>
+void restore(Task_checkpoint const &task, Container &data, double &time, double &dt) {
+  if (task.state.size() != data.size()) {
+    throw ReturnFlag::input_err;
+  }
+  std::copy(task.state.begin(), task.state.end(), data.begin());
+  time = task.time;
+  dt = task.dt;
+}
+
+/*
+ * What an earlier run in the same output_dir left behind. Finished tasks are those in last_state.txt, failed
+ * ones are reported in log.txt; in-flight tasks come from the checkpoint_<n>.txt files of all workers, and the
+ * snapshot of a task from the latest triage stage wins, the most advanced one among those. In 'continue' mode the final states of finished tasks are restart
+ * points as well, except for the tasks stats.txt flags as 'event': a stopping event has decided their outcome.
+ */
+class Restart_table {
+ public:
+  Restart_table() = default;
+
+  Restart_table(std::string const &work_dir, Restart_mode mode) {
+    if (mode == Restart_mode::off) return;
+
+    read_failed(work_dir + "log.txt");
+
+    read_stopped(work_dir + "stats.txt");
+
+    std::unordered_map<size_t, Task_checkpoint> finished;
+
+    read_last_states(work_dir + "last_state.txt", finished);
+
+    for (auto const &entry : std::filesystem::directory_iterator(work_dir)) {
+      auto const name = entry.path().filename().string();
+      if (name.rfind("checkpoint_", 0) == 0 && entry.path().extension() == ".txt") {
+        read_checkpoints(entry.path().string());
+      }
+    }
+
+    for (auto &[id, task] : finished) {
+      if (mode == Restart_mode::extend) {
+        if (task.time >= latest(id)) {
+          tasks_[id] = std::move(task);
+        }
+      } else {
+        tasks_.erase(id);
+        done_.insert(id);
+      }
+    }
+
+    for (auto id : done_) {
+      tasks_.erase(id);
+    }
+  }
+
+  bool done(size_t task_id) const { return done_.count(task_id) != 0; }
+
+  Task_checkpoint const *find(size_t task_id) const {
+    auto it = tasks_.find(task_id);
+    return it == tasks_.end() ? nullptr : &it->second;
+  }
+
+  /* drop the snapshot of a task that has to start over */
+  void forget(size_t task_id) { tasks_.erase(task_id); }
+
+ private:
+  std::unordered_map<size_t, Task_checkpoint> tasks_;
+  std::unordered_set<size_t> done_;
+
+  double latest(size_t task_id) const {
+    auto it = tasks_.find(task_id);
+    return it == tasks_.end() ? -1 : it->second.time;
+  }
+
+  void read_failed(std::string const &path) {
+    std::ifstream file{path};
+    for (std::string line; std::getline(file, line);) {
+      auto const colon = line.find(":Max iteration");
+      if (colon != std::string::npos && is_number(line.substr(0, colon))) {
+        done_.insert(std::stoull(line.substr(0, colon)));
+      }
+    }
+  }
+
+  void read_stopped(std::string const &path) {
+    std::ifstream file{path};
+    for (std::string line; std::getline(file, line);) {
+      std::istringstream is{line};
+      size_t task_id;
+      std::string flag;
+      if (is >> task_id >> flag && flag == "event") {
+        done_.insert(task_id);
+      }
+    }
+  }
+
+  static void read_last_states(std::string const &path, std::unordered_map<size_t, Task_checkpoint> &finished) {
+    std::ifstream file{path};
+    for (std::string line; std::getline(file, line);) {
+      std::istringstream is{line};
+      Task_checkpoint task;
+      if (!(is >> task.task_id >> task.time)) continue;
+      for (double x; is >> x;) {
+        task.state.emplace_back(x);
+      }
+      // no step size was kept: the continued task starts with a fresh estimate
+      task.dt = 0;
+      task.t_out = task.time;
+      finished[task.task_id] = std::move(task);
+    }
+  }
+
+  void read_checkpoints(std::string const &path) {
+    std::ifstream file{path};
+    // the files of earlier versions have no stage, and only triage's stage 1 could have left them behind
+    int stage = 1;
+    for (std::string line; std::getline(file, line);) {
+      std::istringstream is{line};
+      std::string key;
+      if (line.rfind("#stage", 0) == 0 && is >> key >> stage) continue;
+      Task_checkpoint task;
+      if (!(is >> task.task_id >> task.time >> task.dt >> task.t_out >> task.traj_size)) continue;
+      for (double x; is >> x;) {
+        task.state.emplace_back(x);
+      }
+      task.stage = stage;
+      auto it = tasks_.find(task.task_id);
+      if (it == tasks_.end() || std::tie(task.stage, task.time) > std::tie(it->second.stage, it->second.time)) {
+        tasks_[task.task_id] = std::move(task);
+      }
+    }
+  }
+};
+
+/*
+ * Periodic snapshots of the in-flight tasks. Every worker owns checkpoint_<worker>.txt and rewrites it through
+ * a temporary file and a rename, so a kill at any moment leaves the previous snapshot intact. The file starts with
+ * the triage stage of its snapshots, '#stage <n>'. A SIGTERM makes every worker checkpoint at its next step and stop
+ * taking tasks.
+ */
+class Checkpoint {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  Checkpoint(std::string const &work_dir, size_t worker_num, double interval, Restart_table &&restart)
+      : work_dir_{work_dir}, interval_{interval}, last_(worker_num, Clock::now()), restart_{std::move(restart)} {
+    std::signal(SIGTERM, on_signal);
+  }
+
+  static bool terminated() { return terminate_.load(std::memory_order_relaxed) != 0; }
+
+  Task_checkpoint const *find(size_t task_id) const { return restart_.find(task_id); }
+
+  Restart_table const &restart() const { return restart_; }
+
+  /* not thread-safe: between runs of the workers only */
+  void forget(size_t task_id) { restart_.forget(task_id); }
+
+  /* the triage stage the snapshots from now on belong to; between runs of the workers only */
+  void begin_stage(int stage) { stage_ = stage; }
+
+  /* called by the owner of `worker` only */
+  bool due(size_t worker) const {
+    return terminated() ||
+           (interval_ > 0 && Clock::now() - last_[worker] >= std::chrono::duration<double>(interval_));
+  }
+
+  void save(size_t worker, std::vector<Task_checkpoint> const &tasks) {
+    std::string const path = work_dir_ + "checkpoint_" + std::to_string(worker) + ".txt";
+    {
+      std::ofstream file{path + ".tmp"};
+      file << std::setprecision(17) << "#stage " << stage_ << "\r\n";
+      for (auto const &task : tasks) {
+        file << task.task_id << ' ' << task.time << ' ' << task.dt << ' ' << task.t_out << ' ' << task.traj_size;
+        for (auto x : task.state) {
+          file << ' ' << x;
+        }
+        file << "\r\n";
+      }
+    }
+    std::rename((path + ".tmp").c_str(), path.c_str());
+    last_[worker] = Clock::now();
+  }
+
+  /* after a complete run nothing is in flight any more, including what runs with more workers left behind */
+  void clear() {
+    for (auto const &entry : std::filesystem::directory_iterator(work_dir_)) {
+      auto const name = entry.path().filename().string();
+      if (name.rfind("checkpoint_", 0) == 0 || name.rfind("partial_", 0) == 0) {
+        std::filesystem::remove(entry.path());
+      }
+    }
+  }
+
+ private:
+  // written by the signal handler and read by every worker: lock-free, so it is safe in both
+  static inline std::atomic<int> terminate_{0};
+
+  static_assert(std::atomic<int>::is_always_lock_free);
+
+  static void on_signal(int) { terminate_.store(1, std::memory_order_relaxed); }
+
+  std::string work_dir_;
+  double interval_;
+  int stage_{1};
+  std::vector<Clock::time_point> last_;
+  Restart_table restart_;
+};
+
+}  // namespace secular
+#endif
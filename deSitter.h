@@ -1,6 +1,7 @@
 #ifndef DESITTER_H
 #define DESITTER_H
 
+#include "orbit_context.h"
 #include "tools.h"
 
 namespace secular {
@@ -98,29 +99,28 @@ bool is_Lout_needed(Ctrl const &ctrl) {
 template <typename Ctrl, typename Args, typename Container>
 class deSitter_arg {
  public:
-  deSitter_arg(Ctrl const &ctrl, Args const &args, Container const &var) {
+  deSitter_arg(Ctrl const &ctrl, Args const &args, Container const &var, Orbit_context const &orbits) {
     bool const Lin_needed{is_Lin_needed(ctrl)};
 
     bool const Lout_needed{is_Lout_needed(ctrl)};
 
     if (Lin_needed == true) {
-      a_in_eff_ = calc_a_eff(args.a_in_coef(), var.L1x(), var.L1y(), var.L1z(), var.e1x(), var.e1y(), var.e1z());
+      a_in_eff_ = orbits.in.a_eff();
 
       a_in_eff3_ = a_in_eff_ * a_in_eff_ * a_in_eff_;
     }
 
     if (Lout_needed == true) {
       if (ctrl.ave_method == LK_method::DA) {
-        L2x_ = var.L2x(), L2y_ = var.L2y(), L2z_ = var.L2z();
+        L2_ = var.L2();
 
-        a_out_eff_ = calc_a_eff(args.a_out_coef(), var.L2x(), var.L2y(), var.L2z(), var.e2x(), var.e2y(), var.e2z());
+        a_out_eff_ = orbits.out.a_eff();
 
         a_out_eff3_ = a_out_eff_ * a_out_eff_ * a_out_eff_;
       } else if (ctrl.ave_method == LK_method::SA) {
-        std::tie(L2x_, L2y_, L2z_) =
-            cross_with_coef(args.mu_out(), var.rx(), var.ry(), var.rz(), var.vx(), var.vy(), var.vz());
+        L2_ = cross_with_coef(args.mu_out(), var.r(), var.v());
 
-        a_out_eff_ = norm(var.rx(), var.ry(), var.rz());
+        a_out_eff_ = orbits.r;
 
         a_out_eff3_ = a_out_eff_ * a_out_eff_ * a_out_eff_;
       }
@@ -165,125 +165,114 @@ class deSitter_arg {
 
   READ_GETTER(double, S2S3_Omega, Omega_[7]);
 
-  READ_GETTER(double, L2x, L2x_);
-
-  READ_GETTER(double, L2y, L2y_);
-
-  READ_GETTER(double, L2z, L2z_);
+  READ_GETTER(Vec3, L2, L2_);
 
  private:
-  double L2x_{0};
-  double L2y_{0};
-  double L2z_{0};
-  double Omega_[8];
-  double LL_;
-  double a_in_eff_;
-  double a_in_eff3_;
-  double a_out_eff_;
-  double a_out_eff3_;
+  Vec3 L2_{0, 0, 0};
+  double Omega_[8]{0};
+  double LL_{0};
+  double a_in_eff_{0};
+  double a_in_eff3_{0};
+  double a_out_eff_{0};
+  double a_out_eff3_{0};
 };
 
-inline auto deSitter_e_vec(double S1x, double S1y, double S1z, double Lx, double Ly, double Lz) {
-  double dot_part = 3 * dot(Lx, Ly, Lz, S1x, S1y, S1z) / norm2(Lx, Ly, Lz);
-  return std::make_tuple(S1x - dot_part * Lx, S1y - dot_part * Ly, S1z - dot_part * Lz);
+inline Vec3 deSitter_e_vec(Vec3 const &S, Vec3 const &L) {
+  double dot_part = 3 * dot(L, S) / norm2(L);
+  return S - dot_part * L;
 }
 
 template <typename Container>
-auto SA_back_reaction(double Omega, double Sx, double Sy, double Sz, Container const &var) {
-  auto [crvx, crvy, crvz] = cross(var.rx(), var.ry(), var.rz(), var.vx(), var.vy(), var.vz());
-
-  double r2 = norm2(var.rx(), var.ry(), var.rz());
-
-  double const acc_coef = Omega / r2;
+Vec3 SA_back_reaction(double Omega, Vec3 const &S, Container const &var) {
+  Vec3 const r = var.r(), v = var.v();
 
-  auto [csvx, csvy, csvz] = cross(Sx, Sy, Sz, var.vx(), var.vy(), var.vz());
+  Vec3 const crv = cross(r, v);
 
-  auto [csrx, csry, csrz] = cross(Sx, Sy, Sz, var.rx(), var.ry(), var.rz());
+  double r2 = norm2(r);
 
-  double dvr = dot(var.rx(), var.ry(), var.rz(), var.vx(), var.vy(), var.vz());
+  double const acc_coef = Omega / r2;
 
-  double tri_dot = dot(Sx, Sy, Sz, crvx, crvy, crvz);
+  Vec3 const csv = cross(S, v);
 
-  double acc_x = acc_coef * (3 * tri_dot * var.rx() + 2 * r2 * csvx - 3 * dvr * csrx);
+  Vec3 const csr = cross(S, r);
 
-  double acc_y = acc_coef * (3 * tri_dot * var.ry() + 2 * r2 * csvy - 3 * dvr * csry);
+  double dvr = dot(r, v);
 
-  double acc_z = acc_coef * (3 * tri_dot * var.rz() + 2 * r2 * csvz - 3 * dvr * csrz);
+  double tri_dot = dot(S, crv);
 
-  return std::make_tuple(acc_x, acc_y, acc_z);
+  return acc_coef * (3 * tri_dot * r + 2 * r2 * csv - 3 * dvr * csr);
 }
 
-#define DESITTER_IN(C, OMEGA, S)                                                                                     \
-  if (C != deS::off) {                                                                                               \
-    auto [dx, dy, dz] = cross_with_coef(OMEGA, var.L1x(), var.L1y(), var.L1z(), var.S##x(), var.S##y(), var.S##z()); \
-    if (C == deS::on || C == deS::all) {                                                                             \
-      dvar.add_##S(dx, dy, dz);                                                                                      \
-    }                                                                                                                \
-    if (C == deS::bc || C == deS::all) {                                                                             \
-      dvar.sub_L1(dx, dy, dz);                                                                                       \
-      auto [nex, ney, nez] = deSitter_e_vec(var.S##x(), var.S##y(), var.S##z(), var.L1x(), var.L1y(), var.L1z());    \
-      dvar.add_e1(cross_with_coef(OMEGA, nex, ney, nez, var.e1x(), var.e1y(), var.e1z()));                           \
-    }                                                                                                                \
+#define DESITTER_IN(C, OMEGA, S)                                                             \
+  if (C != deS::off) {                                                                       \
+    Vec3 const dS = cross_with_coef(OMEGA, var.L1(), var.S());                               \
+    if (C == deS::on || C == deS::all) {                                                     \
+      dvar.add_##S(dS);                                                                      \
+    }                                                                                        \
+    if (C == deS::bc || C == deS::all) {                                                     \
+      dvar.sub_L1(dS);                                                                       \
+      dvar.add_e1(cross_with_coef(OMEGA, deSitter_e_vec(var.S(), var.L1()), var.e1()));      \
+    }                                                                                        \
   }
 
-#define DESITTER_OUT(C, OMEGA, S)                                                                                   \
-  if (C != deS::off) {                                                                                              \
-    auto [dx, dy, dz] = cross_with_coef(OMEGA, d.L2x(), d.L2y(), d.L2z(), var.S##x(), var.S##y(), var.S##z());      \
-    if (C == deS::on || C == deS::all) {                                                                            \
-      dvar.add_##S(dx, dy, dz);                                                                                     \
-    }                                                                                                               \
-    if (C == deS::bc || C == deS::all) {                                                                            \
-      if (ctrl.ave_method == LK_method::DA) {                                                                       \
-        dvar.sub_L2(dx, dy, dz);                                                                                    \
-        auto [nex, ney, nez] = deSitter_e_vec(var.S##x(), var.S##y(), var.S##z(), var.L2x(), var.L2y(), var.L2z()); \
-        dvar.add_e2(cross_with_coef(OMEGA, nex, ney, nez, var.e2x(), var.e2y(), var.e2z()));                        \
-      } else if (ctrl.ave_method == LK_method::SA) {                                                                \
-        dvar.add_v(SA_back_reaction(OMEGA, var.S##x(), var.S##y(), var.S##z(), var));                               \
-      }                                                                                                             \
-    }                                                                                                               \
+#define DESITTER_OUT(C, OMEGA, S)                                                            \
+  if (C != deS::off) {                                                                       \
+    Vec3 const dS = cross_with_coef(OMEGA, d.L2(), var.S());                                 \
+    if (C == deS::on || C == deS::all) {                                                     \
+      dvar.add_##S(dS);                                                                      \
+    }                                                                                        \
+    if (C == deS::bc || C == deS::all) {                                                     \
+      if (ctrl.ave_method == LK_method::DA) {                                                \
+        dvar.sub_L2(dS);                                                                     \
+        dvar.add_e2(cross_with_coef(OMEGA, deSitter_e_vec(var.S(), var.L2()), var.e2()));    \
+      } else if (ctrl.ave_method == LK_method::SA) {                                         \
+        dvar.add_v(SA_back_reaction(OMEGA, var.S(), var));                                   \
+      }                                                                                      \
+    }                                                                                        \
   }
 
-#define LENS_THIRRING_IN(C, OMEGA, SI, SJ)                                                                         \
-  if (C == deS::on || C == deS::all) {                                                                             \
-    auto [nex, ney, nez] = deSitter_e_vec(var.SI##x(), var.SI##y(), var.SI##z(), var.L1x(), var.L1y(), var.L1z()); \
-    auto [dx, dy, dz] = cross_with_coef(OMEGA, nex, ney, nez, var.SJ##x(), var.SJ##y(), var.SJ##z());              \
-    dvar.add_##SJ(dx, dy, dz);                                                                                     \
+#define LENS_THIRRING_IN(C, OMEGA, SI, SJ)                                                   \
+  if (C == deS::on || C == deS::all) {                                                       \
+    dvar.add_##SJ(cross_with_coef(OMEGA, deSitter_e_vec(var.SI(), var.L1()), var.SJ()));     \
   }
 
-#define LENS_THIRRING_OUT(C, OMEGA, SI, SJ)                                                                  \
-  if (C == deS::on || C == deS::all) {                                                                       \
-    auto [nex, ney, nez] = deSitter_e_vec(var.SI##x(), var.SI##y(), var.SI##z(), d.L2x(), d.L2y(), d.L2z()); \
-    auto [dx, dy, dz] = cross_with_coef(OMEGA, nex, ney, nez, var.SJ##x(), var.SJ##y(), var.SJ##z());        \
-    dvar.add_##SJ(dx, dy, dz);                                                                               \
+#define LENS_THIRRING_OUT(C, OMEGA, SI, SJ)                                                  \
+  if (C == deS::on || C == deS::all) {                                                       \
+    dvar.add_##SJ(cross_with_coef(OMEGA, deSitter_e_vec(var.SI(), d.L2()), var.SJ()));       \
   }
 
 template <typename Control, typename Args, typename Container>
-void spin_orbit_coupling(Control const &ctrl, Args const &args, Container const &var, Container &dvar) {
+void spin_orbit_coupling(Control const &ctrl, Args const &args, Container const &var, Container &dvar,
+                         Orbit_context const &orbits) {
   using deArgs = deSitter_arg<Control, Args, Container>;
-  deArgs d{ctrl, args, var};  // calculate the Omega and L2(Single average case)
-
-  DESITTER_IN(ctrl.Sin_Lin, d.S1L1_Omega(), S1);
-  DESITTER_OUT(ctrl.Sin_Lout, d.S1L2_Omega(), S1);
+  deArgs d{ctrl, args, var, orbits};  // calculate the Omega and L2(Single average case)
 
-  DESITTER_IN(ctrl.Sin_Lin, d.S2L1_Omega(), S2);
-  DESITTER_OUT(ctrl.Sin_Lout, d.S2L2_Omega(), S2);
+  if constexpr (spin_num<Container>::size >= 2) {
+    DESITTER_IN(ctrl.Sin_Lin, d.S1L1_Omega(), S1);
+    DESITTER_OUT(ctrl.Sin_Lout, d.S1L2_Omega(), S1);
 
-  LENS_THIRRING_IN(ctrl.Sin_Sin, d.S1S2_Omega(), S1, S2);
-  LENS_THIRRING_IN(ctrl.Sin_Sin, d.S1S2_Omega(), S2, S1);
+    DESITTER_IN(ctrl.Sin_Lin, d.S2L1_Omega(), S2);
+    DESITTER_OUT(ctrl.Sin_Lout, d.S2L2_Omega(), S2);
 
-  LENS_THIRRING_OUT(ctrl.Sout_Lin, d.S3L1_Omega(), L1, S3);
-  if (ctrl.Sout_Lin == deS::bc || ctrl.Sout_Lin == deS::all) {
-    LENS_THIRRING_OUT(deS::on, d.S3L1_Omega(), S3, L1);
-    LENS_THIRRING_OUT(deS::on, d.S3L1_Omega(), S3, e1);
+    LENS_THIRRING_IN(ctrl.Sin_Sin, d.S1S2_Omega(), S1, S2);
+    LENS_THIRRING_IN(ctrl.Sin_Sin, d.S1S2_Omega(), S2, S1);
   }
 
-  DESITTER_OUT(ctrl.Sout_Lout, d.S3L2_Omega(), S3);
+  if constexpr (spin_num<Container>::size >= 3) {
+    LENS_THIRRING_OUT(ctrl.Sout_Lin, d.S3L1_Omega(), L1, S3);
+    if (ctrl.Sout_Lin == deS::bc || ctrl.Sout_Lin == deS::all) {
+      LENS_THIRRING_OUT(deS::on, d.S3L1_Omega(), S3, L1);
+      LENS_THIRRING_OUT(deS::on, d.S3L1_Omega(), S3, e1);
+    }
 
-  LENS_THIRRING_OUT(ctrl.Sin_Sout, d.S1S3_Omega(), S3, S1);
-  LENS_THIRRING_OUT(ctrl.Sin_Sout, d.S2S3_Omega(), S3, S2);
-  if (ctrl.Sin_Sout == deS::bc || ctrl.Sin_Sout == deS::all) {
-    LENS_THIRRING_OUT(deS::on, d.S1S3_Omega(), S1, S3);
-    LENS_THIRRING_OUT(deS::on, d.S2S3_Omega(), S2, S3);
+    DESITTER_OUT(ctrl.Sout_Lout, d.S3L2_Omega(), S3);
+
+    LENS_THIRRING_OUT(ctrl.Sin_Sout, d.S1S3_Omega(), S3, S1);
+    LENS_THIRRING_OUT(ctrl.Sin_Sout, d.S2S3_Omega(), S3, S2);
+    if (ctrl.Sin_Sout == deS::bc || ctrl.Sin_Sout == deS::all) {
+      LENS_THIRRING_OUT(deS::on, d.S1S3_Omega(), S1, S3);
+      LENS_THIRRING_OUT(deS::on, d.S2S3_Omega(), S2, S3);
+    }
   }
 
   DESITTER_OUT(ctrl.LL, d.LL(), L1);
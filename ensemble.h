@@ -0,0 +1,498 @@
+#ifndef SECULAR_ENSEMBLE_H
+#define SECULAR_ENSEMBLE_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "archive.h"
+#include "observer.h"
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * The per-task quantities an ensemble reduces:
+ *   e_max    the largest e_in;
+ *   r_p_min  the smallest pericenter a_in (1 - e_in) in au;
+ *   flips    how often cos(i_mutual) changed its sign;
+ *   t_merge  the time in yr a task was stopped at by GW_in or a stopping event, for the tasks that were;
+ *   i_final  the mutual inclination in deg the task ended with.
+ */
+enum class Ensemble_quantity { e_max, r_p_min, flips, t_merge, i_final };
+
+constexpr size_t ensemble_quantity_num = 5;
+
+const std::string str_ensemble_quantity[ensemble_quantity_num] = {"e_max", "r_p_min", "flips", "t_merge", "i_final"};
+
+/* the quantiles ensemble.txt lists */
+constexpr std::array<double, 9> ensemble_quantiles = {0.01, 0.05, 0.1, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99};
+
+enum class Bin_scale { lin, log };
+
+/* one config value per quantity, "off" or the histogram range "<lin|log>:<low>:<high>", e.g. "log:1e-6:1e4" */
+struct Histogram_setting {
+  bool on{true};
+  Bin_scale scale{Bin_scale::lin};
+  double low{0};
+  double high{1};
+};
+
+Histogram_setting str_to_histogram_setting(std::string const &key) {
+  Histogram_setting setting;
+
+  if (case_insens_equals(key, "off")) {
+    setting.on = false;
+    return setting;
+  }
+
+  auto const first = key.find(':');
+  auto const second = first == std::string::npos ? first : key.find(':', first + 1);
+
+  if (second == std::string::npos) {
+    throw ReturnFlag::input_err;
+  }
+
+  std::string const scale = key.substr(0, first);
+
+  if (case_insens_equals(scale, "lin")) {
+    setting.scale = Bin_scale::lin;
+  } else if (case_insens_equals(scale, "log")) {
+    setting.scale = Bin_scale::log;
+  } else {
+    throw ReturnFlag::input_err;
+  }
+
+  setting.low = std::stod(key.substr(first + 1, second - first - 1));
+  setting.high = std::stod(key.substr(second + 1));
+
+  if (setting.low >= setting.high || (setting.scale == Bin_scale::log && setting.low <= 0)) {
+    throw ReturnFlag::input_err;
+  }
+  return setting;
+}
+
+/*
+ * 'ensemble = on' reduces the tasks of a run to ensemble.txt: the count, mean, extremes and quantiles of every
+ * quantity, and its histogram. The keys:
+ *   ensemble_<quantity>  "off" to leave the quantity out, or its histogram range (see Histogram_setting), by default
+ *                        lin:0:1 for e_max, log:1e-6:1e4 for r_p_min, lin:0:100 for flips, log:1:1e11 for t_merge and
+ *                        lin:0:180 for i_final;
+ *   ensemble_bins        bins per histogram (100);
+ *   ensemble_accuracy    relative accuracy of the quantiles (0.01).
+ */
+struct Ensemble_config {
+  Ensemble_config() = default;
+
+  template <typename Config>
+  explicit Ensemble_config(Config &cfg) {
+    on = str_to_bool(get_optional<std::string>(cfg, "ensemble", "off"));
+
+    bins = get_optional<size_t>(cfg, "ensemble_bins", 100);
+
+    accuracy = get_optional<double>(cfg, "ensemble_accuracy", 0.01);
+
+    std::string const defaults[ensemble_quantity_num] = {"lin:0:1", "log:1e-6:1e4", "lin:0:100", "log:1:1e11",
+                                                         "lin:0:180"};
+
+    for (size_t i = 0; i < ensemble_quantity_num; ++i) {
+      setting[i] = str_to_histogram_setting(
+          get_optional<std::string>(cfg, "ensemble_" + str_ensemble_quantity[i], defaults[i]));
+    }
+
+    if (bins == 0 || accuracy <= 0 || accuracy >= 1) {
+      throw ReturnFlag::input_err;
+    }
+  }
+
+  bool on{false};
+  size_t bins{100};
+  double accuracy{0.01};
+  std::array<Histogram_setting, ensemble_quantity_num> setting;
+};
+
+/* fixed bins over [low, high), linear or in log, with one bin below and one above the range */
+class Histogram {
+ public:
+  Histogram(Histogram_setting const &setting, size_t bins) : setting_{setting}, counts_(bins + 2, 0) {
+    if (setting.scale == Bin_scale::log) {
+      lo_ = log(setting.low), width_ = (log(setting.high) - lo_) / bins;
+    } else {
+      lo_ = setting.low, width_ = (setting.high - setting.low) / bins;
+    }
+  }
+
+  void add(double x) {
+    double const pos = ((setting_.scale == Bin_scale::log ? log(x) : x) - lo_) / width_;
+
+    size_t const bins = counts_.size() - 2;
+
+    if (!(pos >= 0)) {
+      counts_.front()++;
+    } else if (pos >= bins) {
+      counts_.back()++;
+    } else {
+      counts_[1 + static_cast<size_t>(pos)]++;
+    }
+  }
+
+  void merge(Histogram const &other) {
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      counts_[i] += other.counts_[i];
+    }
+  }
+
+  /* "<lin|log> <low> <high> <below> <bin 1> ... <bin n> <above>" */
+  void write(std::ostream &os) const {
+    os << (setting_.scale == Bin_scale::log ? "log" : "lin") << ' ' << setting_.low << ' ' << setting_.high;
+    for (auto n : counts_) {
+      os << ' ' << n;
+    }
+  }
+
+  /* adds what write put out; false if it was written with another range or bin count */
+  bool read(std::istream &is) {
+    std::string scale;
+    double low, high;
+
+    if (!(is >> scale >> low >> high) || scale != (setting_.scale == Bin_scale::log ? "log" : "lin") ||
+        low != setting_.low || high != setting_.high) {
+      return false;
+    }
+
+    std::vector<size_t> counts;
+    for (size_t n; is >> n;) {
+      counts.emplace_back(n);
+    }
+
+    if (counts.size() != counts_.size()) return false;
+
+    for (size_t i = 0; i < counts_.size(); ++i) {
+      counts_[i] += counts[i];
+    }
+    return true;
+  }
+
+ private:
+  Histogram_setting setting_;
+  std::vector<size_t> counts_;
+  double lo_{0};
+  double width_{1};
+};
+
+/*
+ * Mergeable quantile sketch with relative accuracy alpha (DDSketch, Masson, Rim & Lee 2019). x > 0 goes into the
+ * bucket i = ceil(log(x) / log(gamma)), gamma = (1 + alpha) / (1 - alpha), which holds (gamma^(i-1), gamma^i]; a
+ * quantile is read off as 2 gamma^i / (gamma + 1), within alpha of any value in its bucket. x <= 0 is counted apart
+ * and read off as 0. The buckets cover what the quantity spans in log, a few thousand at most for alpha = 0.01.
+ */
+class Quantile_sketch {
+ public:
+  explicit Quantile_sketch(double alpha) : alpha_{alpha}, log_gamma_{log((1 + alpha) / (1 - alpha))} {}
+
+  void add(double x) {
+    if (x > std::numeric_limits<double>::min()) {
+      buckets_[static_cast<int>(ceil(log(x) / log_gamma_))]++;
+    } else {
+      zeros_++;
+    }
+    count_++;
+  }
+
+  void merge(Quantile_sketch const &other) {
+    for (auto [i, n] : other.buckets_) {
+      buckets_[i] += n;
+    }
+    zeros_ += other.zeros_;
+    count_ += other.count_;
+  }
+
+  size_t count() const { return count_; }
+
+  /* the q quantile, the value of rank q (count - 1) */
+  double quantile(double q) const {
+    double const rank = q * (count_ - 1);
+
+    size_t seen = zeros_;
+
+    if (rank < seen) return 0;
+
+    int bucket = 0;
+
+    for (auto [i, n] : buckets_) {
+      bucket = i;
+      seen += n;
+      if (rank < seen) break;
+    }
+    return 2 * exp(bucket * log_gamma_) / (exp(log_gamma_) + 1);
+  }
+
+  /* "<alpha> <zeros> <i>:<count> ..." */
+  void write(std::ostream &os) const {
+    os << alpha_ << ' ' << zeros_;
+    for (auto [i, n] : buckets_) {
+      os << ' ' << i << ':' << n;
+    }
+  }
+
+  /* adds what write put out; false if it was written with another accuracy */
+  bool read(std::istream &is) {
+    double alpha;
+    size_t zeros;
+
+    if (!(is >> alpha >> zeros) || alpha != alpha_) return false;
+
+    zeros_ += zeros;
+    count_ += zeros;
+
+    for (std::string bucket; is >> bucket;) {
+      auto const colon = bucket.find(':');
+      if (colon == std::string::npos) return false;
+      size_t const n = std::stoull(bucket.substr(colon + 1));
+      buckets_[std::stoi(bucket.substr(0, colon))] += n;
+      count_ += n;
+    }
+    return true;
+  }
+
+ private:
+  double alpha_;
+  double log_gamma_;
+  std::map<int, size_t> buckets_;
+  size_t zeros_{0};
+  size_t count_{0};
+};
+
+/*
+ * The online reduction of a run. Each worker adds the tasks it returns to a tally of its own, without locks; the
+ * tallies are merged into ensemble.txt once the workers are done, which also holds the histograms and the sketches
+ * themselves, so that a resumed run adds to the ensemble.txt of the run it resumes. Tasks that end in max_iter are
+ * only counted, and so are quiescent tasks that stopped short of t_end for want of a closed form, under the flag
+ * quiescent_early: their extremes and final inclination are those of the stop, not of the run. A task resumed from
+ * a snapshot contributes its extremes from the snapshot on.
+ */
+class Ensemble {
+ public:
+  Ensemble(std::string const &work_dir, Ensemble_config const &cfg, size_t worker_num, bool resume)
+      : path_{work_dir + "ensemble.txt"}, cfg_{cfg} {
+    for (size_t i = 0; i <= worker_num; ++i) {
+      tallies_.emplace_back(std::make_unique<Tally>(cfg));
+    }
+
+    if (resume && std::filesystem::exists(path_)) {
+      read(*tallies_.back());
+    }
+  }
+
+  /* called by the owner of `worker` only */
+  void record(size_t worker, ReturnFlag flag, double time, double t_end, Orbit_summary const &s) {
+    Tally &tally = *tallies_[worker];
+
+    if (flag == ReturnFlag::quiescent && time < t_end) {
+      tally.flags["quiescent_early"]++;
+      return;
+    }
+
+    tally.flags[to_string(flag)]++;
+
+    if (flag != ReturnFlag::finish && flag != ReturnFlag::event && flag != ReturnFlag::quiescent) return;
+
+    bool const merged = flag == ReturnFlag::event || (flag == ReturnFlag::finish && time < t_end);
+
+    constexpr double deg = 180.0 / consts::pi;
+
+    double const values[ensemble_quantity_num] = {s.e_max, s.r_p_min, static_cast<double>(s.flips), time,
+                                                  acos(std::clamp(s.cos_i, -1.0, 1.0)) * deg};
+
+    for (size_t i = 0; i < ensemble_quantity_num; ++i) {
+      if (!cfg_.setting[i].on || (static_cast<Ensemble_quantity>(i) == Ensemble_quantity::t_merge && !merged)) {
+        continue;
+      }
+      tally.stats[i].add(values[i]);
+    }
+  }
+
+  /* after the workers are done */
+  void write() {
+    Tally total{cfg_};
+
+    for (auto const &tally : tallies_) {
+      total.merge(*tally);
+    }
+
+    size_t tasks = 0;
+    for (auto const &[flag, n] : total.flags) {
+      tasks += n;
+    }
+
+    std::ofstream file{path_};
+
+    file << std::setprecision(16) << "#ensemble of " << tasks << " task(s)\r\n#flag tasks\r\n";
+
+    for (auto const &[flag, n] : total.flags) {
+      file << "flag " << flag << ' ' << n << "\r\n";
+    }
+
+    file << "#quantile quantity tasks mean min max";
+    for (auto q : ensemble_quantiles) {
+      file << " p" << std::lround(q * 100);
+    }
+    file << "\r\n";
+
+    for_each_quantity([&](size_t i, auto const &name) {
+      auto const &stat = total.stats[i];
+      file << std::setprecision(6) << "quantile " << name << ' ' << stat.count;
+      if (stat.count > 0) {
+        file << ' ' << stat.sum / stat.count << ' ' << stat.min << ' ' << stat.max;
+        for (auto q : ensemble_quantiles) {
+          file << ' ' << stat.sketch.quantile(q);
+        }
+      }
+      file << "\r\n";
+    });
+
+    file << "#histogram quantity scale low high below bins... above\r\n";
+
+    for_each_quantity([&](size_t i, auto const &name) {
+      file << std::setprecision(16) << "histogram " << name << ' ';
+      total.stats[i].histogram.write(file);
+      file << "\r\n";
+    });
+
+    file << "#moments quantity tasks sum min max\r\n";
+
+    for_each_quantity([&](size_t i, auto const &name) {
+      auto const &stat = total.stats[i];
+      file << "moments " << name << ' ' << stat.count << ' ' << stat.sum;
+      if (stat.count > 0) {
+        file << ' ' << stat.min << ' ' << stat.max;
+      }
+      file << "\r\n";
+    });
+
+    file << "#sketch quantity accuracy zeros bucket:tasks...\r\n";
+
+    for_each_quantity([&](size_t i, auto const &name) {
+      file << "sketch " << name << ' ';
+      total.stats[i].sketch.write(file);
+      file << "\r\n";
+    });
+  }
+
+ private:
+  struct Stat {
+    Stat(Ensemble_config const &cfg, size_t i) : histogram{cfg.setting[i], cfg.bins}, sketch{cfg.accuracy} {}
+
+    size_t count{0};
+    double sum{0};
+    double min{std::numeric_limits<double>::max()};
+    double max{-std::numeric_limits<double>::max()};
+    Histogram histogram;
+    Quantile_sketch sketch;
+
+    void add(double x) {
+      count++, sum += x, min = std::min(min, x), max = std::max(max, x);
+      histogram.add(x);
+      sketch.add(x);
+    }
+
+    void merge(Stat const &other) {
+      count += other.count, sum += other.sum, min = std::min(min, other.min), max = std::max(max, other.max);
+      histogram.merge(other.histogram);
+      sketch.merge(other.sketch);
+    }
+  };
+
+  struct Tally {
+    explicit Tally(Ensemble_config const &cfg) {
+      for (size_t i = 0; i < ensemble_quantity_num; ++i) {
+        stats.emplace_back(cfg, i);
+      }
+    }
+
+    std::map<std::string, size_t> flags;
+    std::vector<Stat> stats;
+
+    void merge(Tally const &other) {
+      for (auto const &[flag, n] : other.flags) {
+        flags[flag] += n;
+      }
+      for (size_t i = 0; i < stats.size(); ++i) {
+        stats[i].merge(other.stats[i]);
+      }
+    }
+  };
+
+  std::string path_;
+  Ensemble_config cfg_;
+  // one per worker, and the last one for what an earlier run left in ensemble.txt
+  std::vector<std::unique_ptr<Tally>> tallies_;
+
+  template <typename Func>
+  void for_each_quantity(Func &&func) const {
+    for (size_t i = 0; i < ensemble_quantity_num; ++i) {
+      if (cfg_.setting[i].on) {
+        func(i, str_ensemble_quantity[i]);
+      }
+    }
+  }
+
+  void read(Tally &tally) {
+    std::ifstream file{path_};
+
+    for (std::string line; std::getline(file, line);) {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+
+      std::istringstream is{line};
+      std::string kind, name;
+
+      if (!(is >> kind >> name) || kind.front() == '#') continue;
+
+      if (kind == "flag") {
+        size_t n = 0;
+        is >> n;
+        tally.flags[name] += n;
+        continue;
+      }
+
+      auto const found = std::find(std::begin(str_ensemble_quantity), std::end(str_ensemble_quantity), name);
+
+      size_t const i = found - std::begin(str_ensemble_quantity);
+
+      if (kind == "quantile" || (found != std::end(str_ensemble_quantity) && !cfg_.setting[i].on)) continue;
+
+      bool ok = found != std::end(str_ensemble_quantity);
+
+      if (ok && kind == "moments") {
+        Stat &stat = tally.stats[i];
+        size_t count;
+        double sum, min = stat.min, max = stat.max;
+        ok = is >> count >> sum && (count == 0 || is >> min >> max);
+        if (ok) {
+          stat.count += count, stat.sum += sum, stat.min = std::min(stat.min, min), stat.max = std::max(stat.max, max);
+        }
+      } else if (ok && kind == "histogram") {
+        ok = tally.stats[i].histogram.read(is);
+      } else if (ok && kind == "sketch") {
+        ok = tally.stats[i].sketch.read(is);
+      }
+
+      if (!ok) {
+        throw std::runtime_error(path_ + " was written with other ensemble settings: " + line);
+      }
+    }
+  }
+};
+
+}  // namespace secular
+#endif
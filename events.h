@@ -0,0 +1,272 @@
+#ifndef SECULAR_EVENTS_H
+#define SECULAR_EVENTS_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "LK.h"
+#include "secular.h"
+#include "tools.h"
+
+namespace secular {
+
+enum class Event_action { off, log, stop };
+
+/*
+ * The event functions. An event happens when its function changes sign: a_in, r_p and stability fire on the
+ * way down (a_in <= ratio * a_in_init, a_in * (1 - e_in) <= r_p limit, Mardling & Aarseth 2001 criterion
+ * violated), flip fires on every sign change of cos i_mutual.
+ */
+enum class Event_type { a_in, r_p, flip, stability };
+
+constexpr size_t event_num = 4;
+
+const std::string str_event[event_num] = {"a_in", "r_p", "flip", "stability"};
+
+/* one config value per event, "<action>[:<threshold>]", e.g. "stop:0.01", "log:1e-3", "log", "off" */
+struct Event_setting {
+  Event_action action{Event_action::off};
+  double threshold{0};
+};
+
+Event_setting str_to_event_setting(std::string const &key) {
+  auto const colon = key.find(':');
+
+  std::string const action = key.substr(0, colon);
+
+  Event_setting setting;
+
+  if (case_insens_equals(action, "off")) {
+    setting.action = Event_action::off;
+  } else if (case_insens_equals(action, "log")) {
+    setting.action = Event_action::log;
+  } else if (case_insens_equals(action, "stop")) {
+    setting.action = Event_action::stop;
+  } else {
+    throw ReturnFlag::input_err;
+  }
+
+  if (colon != std::string::npos) {
+    setting.threshold = std::stod(key.substr(colon + 1));
+  }
+  return setting;
+}
+
+struct Event_config {
+  Event_config() = default;
+
+  template <typename Config>
+  explicit Event_config(Config const &cfg) {
+    for (size_t i = 0; i < event_num; ++i) {
+      setting[i] = str_to_event_setting(get_optional<std::string>(cfg, "event_" + str_event[i], "off"));
+    }
+  }
+
+  bool any() const {
+    return std::any_of(setting.begin(), setting.end(), [](auto const &s) { return s.action != Event_action::off; });
+  }
+
+  std::array<Event_setting, event_num> setting;
+};
+
+struct Event_hit {
+  Event_type type;
+  Event_action action;
+  double time;
+};
+
+/*
+ * Watches the event functions of one task. After every accepted step the sign of each function is compared
+ * with the one at the end of the previous step; a change is located with the Illinois method on the dense
+ * output of the step, so a stop happens at the event itself instead of at the end of the overshooting step.
+ */
+class Event_detector {
+ public:
+  Event_detector(Event_config const &cfg, SecularConst const &args, LK_method method, double a_in_init)
+      : cfg_{cfg},
+        a_in_coef_{args.a_in_coef()},
+        a_out_coef_{args.a_out_coef()},
+        mu_out_{consts::G * args.m_tot()},
+        q_out_{args.m3() / args.m12()},
+        a_in_min_{cfg.setting[0].threshold * a_in_init},
+        SA_{method == LK_method::SA} {
+    for (size_t i = 0; i < event_num; ++i) {
+      on_[i] = cfg.setting[i].action != Event_action::off;
+    }
+  }
+
+  bool on() const { return cfg_.any(); }
+
+  /* start watching from x; a terminal condition that already holds at the start is reported as a hit */
+  template <typename State>
+  std::vector<Event_hit> reset(State const &x, double t) {
+    evaluate(x, g_);
+    std::vector<Event_hit> hits;
+    for (size_t i = 0; i < event_num; ++i) {
+      if (on_[i] && static_cast<Event_type>(i) != Event_type::flip && g_[i] <= 0) {
+        hits.emplace_back(Event_hit{static_cast<Event_type>(i), cfg_.setting[i].action, t});
+      }
+    }
+    return hits;
+  }
+
+  /*
+   * Events inside the last accepted step [t0, t1], ending at x1, in time order and up to the first terminal
+   * one. interp(t, x) evaluates the dense output of that step.
+   */
+  template <typename State, typename Interp>
+  std::vector<Event_hit> check(double t0, double t1, State const &x1, Interp &&interp) {
+    std::array<double, event_num> g1;
+    evaluate(x1, g1);
+
+    std::vector<Event_hit> hits;
+
+    State x = x1;
+
+    for (size_t i = 0; i < event_num; ++i) {
+      if (!on_[i] || !crossed(static_cast<Event_type>(i), g_[i], g1[i])) continue;
+
+      auto g = [&](double t) {
+        interp(t, x);
+        return event_function(static_cast<Event_type>(i), x);
+      };
+
+      double const t = locate(g, t0, t1, g_[i], g1[i]);
+
+      hits.emplace_back(Event_hit{static_cast<Event_type>(i), cfg_.setting[i].action, t});
+    }
+
+    std::sort(hits.begin(), hits.end(), [](auto const &a, auto const &b) { return a.time < b.time; });
+
+    auto stop = std::find_if(hits.begin(), hits.end(), [](auto const &h) { return h.action == Event_action::stop; });
+    if (stop != hits.end()) {
+      hits.erase(stop + 1, hits.end());
+    }
+
+    g_ = g1;
+    return hits;
+  }
+
+ private:
+  Event_config cfg_;
+  double a_in_coef_;
+  double a_out_coef_;
+  double mu_out_;
+  double q_out_;
+  double a_in_min_;
+  bool SA_;
+  std::array<bool, event_num> on_;
+  std::array<double, event_num> g_;
+
+  static bool crossed(Event_type type, double g0, double g1) {
+    if (type == Event_type::flip) {
+      return (g0 > 0) != (g1 > 0);
+    } else {
+      return g0 > 0 && g1 <= 0;
+    }
+  }
+
+  template <typename State>
+  void evaluate(State const &x, std::array<double, event_num> &g) const {
+    for (size_t i = 0; i < event_num; ++i) {
+      g[i] = on_[i] ? event_function(static_cast<Event_type>(i), x) : 1.0;
+    }
+  }
+
+  template <typename State>
+  double event_function(Event_type type, State const &x) const {
+    switch (type) {
+      case Event_type::a_in:
+        return calc_a(a_in_coef_, x.L1x(), x.L1y(), x.L1z(), x.e1x(), x.e1y(), x.e1z()) - a_in_min_;
+      case Event_type::r_p: {
+        double const a_in = calc_a(a_in_coef_, x.L1x(), x.L1y(), x.L1z(), x.e1x(), x.e1y(), x.e1z());
+        return a_in * (1 - norm(x.e1x(), x.e1y(), x.e1z())) - cfg_.setting[1].threshold;
+      }
+      case Event_type::flip: {
+        auto const L_out = outer_L_direction(x);
+        return dot(x.L1x(), x.L1y(), x.L1z(), UNPACK3(L_out));
+      }
+      case Event_type::stability:
+        return stability_margin(x);
+      default:
+        return 1.0;
+    }
+  }
+
+  /* the outer angular momentum in DA, r x v in SA; only its direction is used */
+  template <typename State>
+  auto outer_L_direction(State const &x) const {
+    if (SA_) {
+      return cross(x.rx(), x.ry(), x.rz(), x.vx(), x.vy(), x.vz());
+    } else {
+      return std::make_tuple(x.L2x(), x.L2y(), x.L2z());
+    }
+  }
+
+  /* a_out(1 - e_out) / a_in minus the critical ratio of Mardling & Aarseth (2001) */
+  template <typename State>
+  double stability_margin(State const &x) const {
+    double const a_in = calc_a(a_in_coef_, x.L1x(), x.L1y(), x.L1z(), x.e1x(), x.e1y(), x.e1z());
+
+    double a_out, e_out;
+
+    if (SA_) {
+      double const r = norm(x.rx(), x.ry(), x.rz());
+      double const v2 = norm2(x.vx(), x.vy(), x.vz());
+      double const rv = dot(x.rx(), x.ry(), x.rz(), x.vx(), x.vy(), x.vz());
+      double const A = v2 - mu_out_ / r;
+
+      a_out = 1 / (2 / r - v2 / mu_out_);
+      e_out = norm(A * x.rx() - rv * x.vx(), A * x.ry() - rv * x.vy(), A * x.rz() - rv * x.vz()) / mu_out_;
+    } else {
+      a_out = calc_a(a_out_coef_, x.L2x(), x.L2y(), x.L2z(), x.e2x(), x.e2y(), x.e2z());
+      e_out = norm(x.e2x(), x.e2y(), x.e2z());
+    }
+
+    if (a_out <= 0 || e_out >= 1) return -1.0;
+
+    auto const L_out = outer_L_direction(x);
+
+    auto const L_in = std::make_tuple(x.L1x(), x.L1y(), x.L1z());
+
+    double const cos_i = dot(L_in, L_out) / (norm(L_in) * norm(L_out));
+
+    double const i_mut = acos(std::clamp(cos_i, -1.0, 1.0));
+
+    double const critical = 2.8 * pow(1 + q_out_, 0.4) * pow(1 + e_out, 0.4) * pow(1 - e_out, -0.2) *
+                            (1 - 0.3 * i_mut / consts::pi);
+
+    return a_out * (1 - e_out) / a_in - critical;
+  }
+
+  /* Illinois variant of regula falsi on [t0, t1] with g(t0) = g0, g(t1) = g1 of opposite signs */
+  template <typename G>
+  static double locate(G &&g, double t0, double t1, double g0, double g1) {
+    double const tol = 1e-13 * std::max(fabs(t0), fabs(t1)) + 1e-300;
+    int side = 0;
+
+    for (size_t iter = 0; iter < 100 && fabs(t1 - t0) > tol; ++iter) {
+      double const t = (t0 * g1 - t1 * g0) / (g1 - g0);
+      double const gt = g(t);
+
+      if ((gt > 0) == (g1 > 0)) {
+        t1 = t;
+        g1 = gt;
+        if (side == -1) g0 *= 0.5;
+        side = -1;
+      } else {
+        t0 = t;
+        g0 = gt;
+        if (side == 1) g1 *= 0.5;
+        side = 1;
+      }
+    }
+    return t1;
+  }
+};
+
+}  // namespace secular
+#endif
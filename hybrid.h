@@ -0,0 +1,88 @@
+#ifndef SECULAR_HYBRID_H
+#define SECULAR_HYBRID_H
+
+#include <cmath>
+
+#include "LK.h"
+#include "secular.h"
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * Per-task averaging switch of LK_method = hybrid. A task runs double averaged while DA_validity stays above
+ * hybrid_ratio and is carried over to the single average, outer body placed on its orbit, once it drops below;
+ * it goes back to DA when the ratio has recovered to twice the threshold, so a task near the boundary does not
+ * flip every step. The outer body keeps its mean anomaly running at the mean motion in DA, so successive SA
+ * excursions pick the orbit phase up where the input row left it.
+ *
+ * Whatever leaves the integrator (trajectory, last_state, checkpoints, events) is in DA form, which keeps the
+ * columns of a hybrid trajectory fixed.
+ */
+class Hybrid_averaging {
+ public:
+  Hybrid_averaging(Controller const &ctrl, SecularConst const &args, double M_init)
+      : args_{args}, ratio_{ctrl.hybrid_ratio}, M_init_{M_init * consts::pi / 180}, on_{ctrl.hybrid} {}
+
+  bool on() const { return on_; }
+
+  bool SA() const { return SA_; }
+
+  /* switch the averaging of x if the criterion asks for it; true if it did, the stepper must then restart */
+  template <typename Container>
+  bool update(Container &x, double t) {
+    if (!on_) return false;
+
+    double const validity = DA_validity(args_, x, SA_ ? LK_method::SA : LK_method::DA);
+
+    if (!SA_ && validity < ratio_) {
+      DA_to_SA(args_, x, mean_anomaly(x, t));
+      SA_ = true;
+      return true;
+    } else if (SA_ && validity > 2 * ratio_) {
+      SA_to_DA(args_, x);
+      SA_ = false;
+      return true;
+    }
+    return false;
+  }
+
+  /* a step size that resolves the outer orbit after a switch to SA */
+  template <typename Container>
+  double SA_step(Container const &x) const {
+    return 0.01 * outer_period(x);
+  }
+
+  template <typename Container>
+  void to_output(Container &x) const {
+    if (SA_) SA_to_DA(args_, x);
+  }
+
+  template <typename Container>
+  Container output(Container x) const {
+    to_output(x);
+    return x;
+  }
+
+ private:
+  SecularConst const &args_;
+  double ratio_;
+  double M_init_;
+  bool on_;
+  bool SA_{false};
+
+  template <typename Container>
+  double outer_period(Container const &x) const {
+    Container osc = output(x);
+    double const a_out = calc_a(args_.a_out_coef(), osc.L2x(), osc.L2y(), osc.L2z(), osc.e2x(), osc.e2y(), osc.e2z());
+    return 2 * consts::pi * sqrt(a_out * a_out * a_out / (consts::G * args_.m_tot()));
+  }
+
+  template <typename Container>
+  double mean_anomaly(Container const &x, double t) const {
+    return fmod(M_init_ + 2 * consts::pi * t / outer_period(x), 2 * consts::pi);
+  }
+};
+
+}  // namespace secular
+#endif
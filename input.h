@@ -0,0 +1,211 @@
+#ifndef SECULAR_INPUT_H
+#define SECULAR_INPUT_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace secular {
+
+/*
+ * Binary initial conditions, host byte order:
+ *   char[8]   magic "SECINIT1"
+ *   uint64    header size in bytes; a multiple of 8, the rows start right after it
+ *   uint64    columns per row
+ *   uint64    column-name length, then the names (input_columns)
+ *   zero padding up to the header size
+ * followed by fixed-width rows of `columns` doubles, the task id included.
+ */
+constexpr char input_magic[8] = {'S', 'E', 'C', 'I', 'N', 'I', 'T', '1'};
+
+/* every column an input row can carry, in order; Controller::initial_format() lists those a config reads */
+inline std::string input_columns() {
+  return "task_id  t_{end}[yr]  dt_{output}[yr]  m_{1}[m_{solar}]  m_{2}[m_{solar}]  m_{3}[m_{solar}]  a_{in}[au]  "
+         "a_{out}[au]  e_{in}  e_{out}  omega_{in}[deg]  omega_{out}[deg]  Omega[deg]  i_{in}[deg]  i_{out}[deg]  "
+         "M(mean anomaly)[deg]  S_{1,x}  S_{1,y}  S_{1,z}  S_{2,x}  S_{2,y}  S_{2,z}  S_{3,x}  S_{3,y}  S_{3,z}";
+}
+
+void write_binary_input(std::ostream &os, std::vector<double> const &rows, size_t columns) {
+  auto put = [&](uint64_t x) { os.write(reinterpret_cast<char const *>(&x), sizeof(x)); };
+
+  std::string const names = input_columns();
+
+  uint64_t const raw_size = sizeof(input_magic) + 3 * sizeof(uint64_t) + names.size();
+
+  uint64_t const header_size = (raw_size + 7) / 8 * 8;
+
+  os.write(input_magic, sizeof(input_magic));
+  put(header_size);
+  put(columns);
+  put(names.size());
+  os.write(names.data(), names.size());
+
+  for (size_t i = raw_size; i < header_size; ++i) {
+    os.put('\0');
+  }
+
+  os.write(reinterpret_cast<char const *>(rows.data()), rows.size() * sizeof(double));
+}
+
+/*
+ * The initial conditions of 'input =', as rows of `columns` doubles back to back. The file is memory-mapped and
+ * read once: a text file is first indexed by its line offsets, which sizes the table, and every line is then
+ * parsed with from_chars straight into its row. A text row holds blank-separated numbers; columns it leaves out
+ * are 0 and columns past the table width are ignored, blank lines and lines starting with '#' are skipped. A file
+ * that starts with input_magic is read as binary instead, with the same padding of short rows.
+ */
+class Input_table {
+ public:
+  Input_table(std::string const &file_name, size_t columns) : columns_{columns} {
+    int const fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("cannot open " + file_name);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("cannot stat " + file_name);
+    }
+
+    size_t const size = static_cast<size_t>(st.st_size);
+
+    if (size == 0) {
+      ::close(fd);
+      return;
+    }
+
+    void *addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+      throw std::runtime_error("cannot map " + file_name);
+    }
+
+    ::madvise(addr, size, MADV_SEQUENTIAL);
+
+    char const *begin = static_cast<char const *>(addr);
+
+    try {
+      if (size >= sizeof(input_magic) && std::memcmp(begin, input_magic, sizeof(input_magic)) == 0) {
+        parse_binary(file_name, begin, size);
+      } else {
+        parse_text(file_name, begin, begin + size);
+      }
+    } catch (...) {
+      ::munmap(addr, size);
+      throw;
+    }
+    ::munmap(addr, size);
+  }
+
+  size_t size() const { return rows_.size() / columns_; }
+
+  size_t columns() const { return columns_; }
+
+  double const *row(size_t i) const { return rows_.data() + i * columns_; }
+
+  /* keep the rows for which keep(row) is true, in order */
+  template <typename Pred>
+  void filter(Pred &&keep) {
+    size_t kept = 0;
+    for (size_t i = 0; i < size(); ++i) {
+      if (keep(row(i))) {
+        std::copy_n(rows_.begin() + i * columns_, columns_, rows_.begin() + kept * columns_);
+        kept++;
+      }
+    }
+    rows_.resize(kept * columns_);
+  }
+
+  /* hands the rows over, leaving the table empty */
+  std::vector<double> release() { return std::move(rows_); }
+
+ private:
+  size_t columns_;
+  std::vector<double> rows_;
+
+  static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+  void parse_text(std::string const &file_name, char const *begin, char const *end) {
+    std::vector<char const *> lines;
+
+    for (char const *p = begin; p < end;) {
+      lines.emplace_back(p);
+      auto const *eol = static_cast<char const *>(std::memchr(p, '\n', end - p));
+      p = eol ? eol + 1 : end;
+    }
+    lines.emplace_back(end);
+
+    rows_.assign((lines.size() - 1) * columns_, 0.0);
+
+    size_t n = 0;
+
+    for (size_t i = 0; i + 1 < lines.size(); ++i) {
+      n += parse_line(file_name, i + 1, lines[i], lines[i + 1], rows_.data() + n * columns_);
+    }
+    rows_.resize(n * columns_);
+  }
+
+  /* parses line `line` of the file into row; false for a line without numbers */
+  bool parse_line(std::string const &file_name, size_t line, char const *p, char const *end, double *row) const {
+    for (; p < end && is_blank(*p); ++p) {
+    }
+
+    if (p == end || *p == '\n' || *p == '#') return false;
+
+    for (size_t col = 0; p < end && *p != '\n';) {
+      double x;
+      auto const [last, ec] = std::from_chars(*p == '+' ? p + 1 : p, end, x);
+
+      if (ec != std::errc{} || (last < end && !is_blank(*last) && *last != '\n')) {
+        throw std::runtime_error(file_name + ":" + std::to_string(line) + ": not a number");
+      }
+
+      if (col < columns_) row[col++] = x;
+
+      for (p = last; p < end && is_blank(*p); ++p) {
+      }
+    }
+    return true;
+  }
+
+  void parse_binary(std::string const &file_name, char const *begin, size_t size) {
+    auto get = [&](size_t pos) {
+      uint64_t x = 0;
+      if (pos + sizeof(x) <= size) std::memcpy(&x, begin + pos, sizeof(x));
+      return static_cast<size_t>(x);
+    };
+
+    size_t const header_size = get(8);
+    size_t const file_columns = get(16);
+
+    if (header_size > size || header_size % 8 != 0 || file_columns == 0 ||
+        (size - header_size) % (file_columns * sizeof(double)) != 0) {
+      throw std::runtime_error(file_name + " is not a complete binary input");
+    }
+
+    size_t const n = (size - header_size) / (file_columns * sizeof(double));
+
+    size_t const copied = std::min(file_columns, columns_);
+
+    rows_.assign(n * columns_, 0.0);
+
+    for (size_t i = 0; i < n; ++i) {
+      std::memcpy(rows_.data() + i * columns_, begin + header_size + i * file_columns * sizeof(double),
+                  copied * sizeof(double));
+    }
+  }
+};
+
+}  // namespace secular
+#endif
@@ -0,0 +1,199 @@
+#ifndef SECULAR_LYAPUNOV_H
+#define SECULAR_LYAPUNOV_H
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "archive.h"
+#include "rng.h"
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * 'lyapunov = on' integrates every task together with a tangent vector and reports its maximal Lyapunov exponent
+ * in lyapunov.txt. The keys:
+ *   lyapunov_tol     the relative accuracy the tangent vector is integrated to (1e-6). Its Jacobian-vector product
+ *                    comes from a finite difference, which is good to about 1e-8, so holding it to the tolerance of the
+ *                    orbit would only shrink the steps;
+ *   lyapunov_renorm  the growth at which the tangent vector is scaled back to its initial length, adding the log of
+ *                    it to the estimate (10).
+ * The tangent integration runs on the scalar controlled steppers; it does not combine with hybrid averaging, events
+ * or dense output, and keeps every task off the closed-form propagation. A quiescent task reports its estimate as of
+ * the step it went quiescent at, and a task resumed from a snapshot starts its estimate anew.
+ */
+struct Lyapunov_config {
+  Lyapunov_config() = default;
+
+  template <typename Config>
+  explicit Lyapunov_config(Config &cfg) {
+    on = str_to_bool(get_optional<std::string>(cfg, "lyapunov", "off"));
+
+    tol = get_optional<double>(cfg, "lyapunov_tol", 1e-6);
+
+    renorm = get_optional<double>(cfg, "lyapunov_renorm", 10.0);
+
+    if (tol <= 0 || renorm <= 1) {
+      throw ReturnFlag::input_err;
+    }
+  }
+
+  bool on{false};
+  double tol{1e-6};
+  double renorm{10};
+};
+
+/*
+ * The variational equations of a RHS func(x, dxdt, t) on the state Container, as one system on [x, w] for the
+ * steppers. The tangent vector is w = D^-1 dx with D the initial length of each 3-vector of x, or 1 where that is
+ * shorter, so that L, e and r count alike; dw/dt = D^-1 J D w takes the Jacobian-vector product from a forward
+ * difference of func along D w, whose step sqrt(DBL_EPSILON) |w| is relative to the lengths of the vectors. That
+ * costs one RHS evaluation on top of the one of x, the price of the second trajectory of a shadow-orbit estimate,
+ * but the tangent stays linear and on the steps of x. w is carried at the length atol / tol, where the absolute
+ * tolerance of the steppers holds it to the relative accuracy tol.
+ */
+template <typename Container, typename Func>
+class Tangent_system {
+ public:
+  static constexpr size_t dim = Container::dim;
+
+  using State = std::array<double, 2 * dim>;
+
+  /* the tangent vector starts in a random direction drawn from the stream (0, task_id) */
+  Tangent_system(Func &func, Container const &x0, size_t task_id, double atol, double tol)
+      : func_{func}, length_{atol / tol} {
+    for (size_t i = 0; i < dim; i += 3) {
+      std::fill_n(scale_.begin() + i, 3, std::max(norm(x0[i], x0[i + 1], x0[i + 2]), 1.0));
+    }
+
+    Counter_rng rng{0, task_id};
+
+    for (auto &w : w0_) {
+      w = rng.normal(0, 1);
+    }
+
+    double const n = length(w0_.data());
+
+    for (auto &w : w0_) {
+      w *= length_ / n;
+    }
+  }
+
+  void operator()(State const &y, State &dydt, double t) {
+    std::copy_n(y.begin(), dim, x_.begin());
+
+    func_(x_, f_, t);
+
+    std::copy_n(f_.begin(), dim, dydt.begin());
+
+    double const n = length(y.data() + dim);
+
+    if (n == 0) {
+      std::fill_n(dydt.begin() + dim, dim, 0.0);
+      return;
+    }
+
+    double const h = sqrt(DBL_EPSILON);
+
+    for (size_t i = 0; i < dim; ++i) {
+      x_[i] += h * scale_[i] * y[dim + i] / n;
+    }
+
+    func_(x_, df_, t);
+
+    for (size_t i = 0; i < dim; ++i) {
+      dydt[dim + i] = (df_[i] - f_[i]) * n / (h * scale_[i]);
+    }
+  }
+
+  /* [x, w0] at the start of the estimate, at time t0 */
+  State pack(Container const &x, double t0) {
+    t0_ = t0;
+    log_growth_ = 0;
+    State y;
+    std::copy(x.begin(), x.end(), y.begin());
+    std::copy(w0_.begin(), w0_.end(), y.begin() + dim);
+    return y;
+  }
+
+  void unpack(State const &y, Container &x) const { std::copy_n(y.begin(), dim, x.begin()); }
+
+  /* scales w back once it grew by renorm; true if it did, which moves the state under the stepper */
+  bool renormalize(State &y, double renorm) {
+    double const growth = length(y.data() + dim) / length_;
+
+    if (growth <= renorm) return false;
+
+    log_growth_ += log(growth);
+
+    for (size_t i = dim; i < 2 * dim; ++i) {
+      y[i] /= growth;
+    }
+    renorms_++;
+    return true;
+  }
+
+  /* the finite-time estimate of the maximal exponent in 1/yr at time t */
+  double exponent(State const &y, double t) const {
+    return t > t0_ ? (log_growth_ + log(length(y.data() + dim) / length_)) / (t - t0_) : 0;
+  }
+
+  size_t renorms() const { return renorms_; }
+
+ private:
+  Func &func_;
+  double length_;
+  std::array<double, dim> scale_;
+  std::array<double, dim> w0_;
+  Container x_;
+  Container f_;
+  Container df_;
+  double t0_{0};
+  double log_growth_{0};
+  size_t renorms_{0};
+
+  static double length(double const *w) {
+    double sum = 0;
+    for (size_t i = 0; i < dim; ++i) {
+      sum += w[i] * w[i];
+    }
+    return sqrt(sum);
+  }
+};
+
+/* lyapunov.txt: the exponent of every task that returned, appended to by a resumed run */
+class Lyapunov {
+ public:
+  Lyapunov(std::string const &work_dir, bool append)
+      : file_{work_dir + "lyapunov.txt", append ? std::fstream::out | std::fstream::app : std::fstream::out} {
+    if (!append) {
+      file_ << "#task_id flag time[yr] lyapunov[1/yr] renormalizations\r\n";
+      file_.flush();
+    }
+  }
+
+  void record(size_t task_id, ReturnFlag flag, double time, double exponent, size_t renorms) {
+    std::ostringstream row;
+    row << std::setprecision(12) << task_id << ' ' << to_string(flag) << ' ' << time << ' ' << exponent << ' '
+        << renorms << "\r\n";
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    file_ << row.str();
+    file_.flush();
+  }
+
+ private:
+  std::ofstream file_;
+  std::mutex mutex_;
+};
+
+}  // namespace secular
+#endif
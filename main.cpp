@@ -1,38 +1,276 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 
 #include "SpaceHub/src/multi-thread/multi-thread.hpp"
 #include "SpaceHub/src/tools/config-reader.hpp"
 #include "SpaceHub/src/tools/timer.hpp"
+#include "analytic.h"
+#include "archive.h"
+#include "batch.h"
+#include "checkpoint.h"
 #include "boost/numeric/odeint.hpp"
+#include "ensemble.h"
+#include "events.h"
+#include "hybrid.h"
+#include "input.h"
+#include "lyapunov.h"
 #include "observer.h"
+#include "population.h"
+#include "projection.h"
+#include "quiescence.h"
 #include "secular.h"
+#include "stepper.h"
+#include "task_pool.h"
+#include "telemetry.h"
+#include "triage.h"
 
 using namespace space::multi_thread;
 using namespace secular;
 
 double ATOL = 1e-13;
 double RTOL = 1e-13;
+bool BATCH = false;
+bool DENSE = false;
+bool PROJECTION = false;
+double PROJECTION_TOL = 0;
+secular::Output_type OUTPUT_TYPE = secular::Output_type::text;
+secular::Output_config OUTPUT;
+secular::Event_config EVENTS;
+secular::Quiescence_config QUIESCENCE;
+secular::Analytic_mode ANALYTIC = secular::Analytic_mode::automatic;
+secular::Stepper_config STEPPER;
+secular::Triage_config TRIAGE;
+secular::Ensemble_config ENSEMBLE;
+secular::Lyapunov_config LYAPUNOV;
 
-bool get_line(std::fstream &is, std::string &str) {
-  std::getline(is, str);
-  if (!is)
-    return false;
-  else
-    return true;
-}
+using TaskPool = std::shared_ptr<secular::Task_pool>;
+using Archive = std::shared_ptr<secular::Task_archive>;
+using CheckpointPtr = std::shared_ptr<secular::Checkpoint>;
+using TriagePtr = std::shared_ptr<secular::Triage>;
+using EnsemblePtr = std::shared_ptr<secular::Ensemble>;
+using LyapunovPtr = std::shared_ptr<secular::Lyapunov>;
 
 constexpr size_t ARGS_OFFSET = 3;
 constexpr size_t PARAMETER_NUM = 25;
+constexpr size_t MAX_ATTEMPTS = 500;
+
+void begin_trajectory(std::ostream &os, secular::Controller const &ctrl, size_t task_id) {
+  if (OUTPUT_TYPE == secular::Output_type::binary) {
+    secular::write_binary_header(os, task_id, 1 + ctrl.state_dim(), secular::get_log_title(ctrl),
+                                 ctrl.output_format());
+  } else {
+    os << std::setprecision(12);
+  }
+}
+
+/*
+ * Sink of one task's trajectory: its own secular_<id> file, or, when the run is archived, an in-memory buffer
+ * that goes to the worker's archive once the task returns. A checkpointed trajectory is reopened where the
+ * snapshot left it; the buffer of an archived one is kept in partial_<id> between runs.
+ */
+struct Trajectory {
+  std::fstream file;
+  std::stringstream buffer;
+  std::ostream *os{&buffer};
+  std::string path;
+  bool archived{false};
+
+  void open(std::string const &work_dir, secular::Controller const &ctrl, size_t task_id, bool on,
+            Archive const &archive, secular::Task_checkpoint const *resume) {
+    buffer.str("");
+    buffer.clear();
+    os = &buffer;
+    archived = static_cast<bool>(archive);
+    path.clear();
+
+    if (!on) return;
+
+    bool const binary = OUTPUT_TYPE == secular::Output_type::binary;
+
+    path = work_dir + (archived ? "partial_" : "secular_") + std::to_string(task_id) + (binary ? ".bin" : ".txt");
+
+    auto const type = binary ? std::fstream::binary : std::fstream::openmode{};
+
+    bool const reopen = resume != nullptr && resume->traj_size >= 0;
+
+    if (archived) {
+      if (reopen) {
+        std::ifstream partial{path, std::fstream::binary};
+        std::string bytes(resume->traj_size, '\0');
+        partial.read(&bytes[0], bytes.size());
+        buffer.write(bytes.data(), partial.gcount());
+        buffer << std::setprecision(12);
+      } else {
+        begin_trajectory(buffer, ctrl, task_id);
+      }
+    } else if (resume != nullptr) {
+      if (reopen && std::filesystem::exists(path)) {
+        std::filesystem::resize_file(path, resume->traj_size);
+      }
+      file.open(path, std::fstream::out | std::fstream::app | type);
+      file << std::setprecision(12);
+      os = &file;
+    } else {
+      file.open(path, std::fstream::out | type);
+      begin_trajectory(file, ctrl, task_id);
+      os = &file;
+    }
+  }
+
+  /* flush what was written so far and return its size in bytes */
+  long long save() {
+    if (path.empty()) return 0;
+
+    if (archived) {
+      std::string const bytes = buffer.str();
+      {
+        std::ofstream partial{path + ".tmp", std::fstream::binary};
+        partial.write(bytes.data(), bytes.size());
+      }
+      std::rename((path + ".tmp").c_str(), path.c_str());
+      return bytes.size();
+    } else {
+      file.flush();
+      return std::filesystem::file_size(path);
+    }
+  }
+
+  /* the task has returned; an archived trajectory no longer needs its partial copy */
+  void close() {
+    if (file.is_open()) {
+      file.close();
+    }
+    if (archived && !path.empty()) {
+      std::remove(path.c_str());
+    }
+  }
+};
+
+/* one row of last_state.txt, in full precision so that a finished task can be continued from it */
+template <typename Container>
+std::string last_state_row(size_t task_id, double time, Container const &data) {
+  std::ostringstream row;
+  row << std::setprecision(16) << task_id << ' ' << time << ' ' << data << "\r\n";
+  return row.str();
+}
+
+/* one row of stats.txt */
+std::string stats_row(size_t task_id, ReturnFlag flag, secular::Task_stats const &stats) {
+  std::ostringstream row;
+  row << std::setprecision(6) << task_id << ' ' << secular::to_string(flag) << ' ' << stats.rhs_calls << ' '
+      << stats.wall_time() << ' ' << stats.accepted << ' ';
+  if (stats.rejects_counted) {
+    row << stats.rejected;
+  } else {
+    row << '-';
+  }
+  row << ' ' << stats.dt_min() << ' ' << stats.dt_median() << ' ' << stats.dt_max() << ' ';
+  if (stats.projecting) {
+    row << stats.projections << ' ' << stats.max_projection();
+  } else {
+    row << "- -";
+  }
+  row << ' ' << stats.dt_histogram() << "\r\n";
+  return row.str();
+}
+
+/* one log line per event; true when the last of them stops the task */
+bool log_events(ConcurrentFile &log, size_t task_id, std::vector<secular::Event_hit> const &hits) {
+  if (hits.empty()) return false;
+
+  for (auto const &hit : hits) {
+    std::ostringstream line;
+    line << std::setprecision(12) << task_id << ":event " << secular::str_event[static_cast<size_t>(hit.type)]
+         << " at t=" << hit.time << '\n';
+    log << line.str();
+  }
+  log.flush();
+
+  return hits.back().action == secular::Event_action::stop;
+}
+
+/*
+ * The closed-form solution lk from time to t_end, sampled at the exact output times or extrema of e_in; the task ends
+ * at exactly t_end. All maxima of the closed form share one e_in, so under a budget the first of a slot is kept.
+ */
+template <typename Container>
+void propagate_closed_form(secular::Quad_LK_propagator const &lk, Container &data, double &time, double t_end,
+                           secular::Stream_observer &writer, secular::Orbit_summary &summary) {
+  Container sample;
+
+  if (writer.extrema()) {
+    for (double t = time;;) {
+      auto const [t_extremum, peak] = lk.extremum_after(t);
+      if (t_extremum > t_end) break;
+      lk(t_extremum, sample);
+      writer.extremum(sample, t_extremum, peak);
+      t = peak ? std::max(t_extremum, writer.slot_end(t_extremum)) : t_extremum;
+    }
+  } else {
+    writer(sample, t_end, [&](double t, Container &x) { lk(t, x); });
+  }
+
+  lk(t_end, data);
 
-auto call_ode_int(std::string work_dir, ConcurrentFile output, secular::Controller const &ctrl,
-                  std::vector<double> const &init_args) {
+  summary.add(data, lk.e_max(t_end));
+
+  time = t_end;
+}
+
+/* true if 'analytic' lets the closed form lk stand in for the integration: in 'auto' only for a fixed outer orbit */
+bool closed_form_holds(secular::Quad_LK_propagator const &lk) {
+  return lk.valid() && (ANALYTIC != secular::Analytic_mode::automatic || lk.coupling() <= secular::test_particle_limit);
+}
+
+/*
+ * Carry a task from time to t_end with the closed-form quadrupole solution when its physics and its orbits allow
+ * it. Tasks that watch events stay on the integrator, which locates them. False if the task has to be integrated.
+ */
+template <typename Container>
+bool propagate_analytic(secular::Controller const &ctrl, secular::SecularConst const &args, Container &data,
+                        double &time, double t_end, secular::Stream_observer &writer, secular::Orbit_summary &summary) {
+  if (ANALYTIC == secular::Analytic_mode::off || EVENTS.any() || LYAPUNOV.on || !secular::analytic_physics(ctrl)) {
+    return false;
+  }
+
+  secular::Quad_LK_propagator const lk{args, data, time};
+
+  if (!closed_form_holds(lk)) return false;
+
+  propagate_closed_form(lk, data, time, t_end, writer, summary);
+
+  return true;
+}
+
+/*
+ * A quiescent task is carried on to t_end in closed form when its physics has one and 'analytic' would have
+ * propagated it that way from the start; any other quiescent task ends where it was stopped, so that its final
+ * state, which 'continue' starts from, is the one of its own evolution.
+ */
+template <typename Container>
+void extrapolate_quiescent(secular::Controller const &ctrl, secular::SecularConst const &args, Container &data,
+                           double &time, double t_end, secular::Stream_observer &writer,
+                           secular::Orbit_summary &summary) {
+  if (time >= t_end || ANALYTIC == secular::Analytic_mode::off || !secular::analytic_physics(ctrl)) return;
+
+  secular::Quad_LK_propagator const lk{args, data, time};
+
+  if (closed_form_holds(lk)) {
+    propagate_closed_form(lk, data, time, t_end, writer, summary);
+  }
+}
+
+auto call_ode_int(std::string work_dir, ConcurrentFile output, ConcurrentFile log, ConcurrentFile stats_file,
+                  secular::Controller const &ctrl, std::vector<double> const &init_args, Archive const &archive,
+                  CheckpointPtr const &checkpoint, TriagePtr const &triage, EnsemblePtr const &ensemble,
+                  LyapunovPtr const &lyapunov, size_t worker) {
   using namespace boost::numeric::odeint;
 
-  using Container = secular::SecularArray;
+  secular::Task_stats stats;
 
   auto [task_id, t_end, out_dt] =
       secular::cast_unpack<decltype(init_args.begin()), size_t, double, double>(init_args.begin());
@@ -41,83 +279,739 @@ auto call_ode_int(std::string work_dir, ConcurrentFile output, secular::Controll
 
   auto const [m1, m2, m3, a_in_init] = secular::unpack_args<4>(init_args.begin() + ARGS_OFFSET);
 
-  std::fstream f_out;
+  auto const *resume = checkpoint->find(task_id);
 
-  if (secular::is_on(out_dt)) {
-    f_out.open(work_dir + "secular_" + std::to_string(task_id) + ".txt", std::fstream::out);
-    f_out << std::setprecision(12);
-  }
+  Trajectory trajectory;
 
-  Container data;
-
-  initialize_orbit_args(ctrl.ave_method, data, init_args.begin() + ARGS_OFFSET);
+  trajectory.open(work_dir, ctrl, task_id, secular::is_on(out_dt), archive, resume);
 
   secular::SecularConst const_parameters{m1, m2, m3};
 
-  double dt = 0.1 * secular::consts::year;
+  secular::Stream_observer writer{*trajectory.os, out_dt, OUTPUT_TYPE, OUTPUT, t_end};
+
+  secular::Hybrid_averaging hybrid{ctrl, const_parameters, init_args[ARGS_OFFSET + 12]};
 
-  double time = 0;
+  // what the triage and the ensemble see of the task
+  secular::Orbit_summary summary{const_parameters.a_in_coef(), ctrl.ave_method == secular::LK_method::SA};
 
-  // auto stepper = make_controlled(ATOL, RTOL, runge_kutta_fehlberg78<Container>());
+  bool const summarized = triage || ensemble;
 
-  auto stepper = bulirsch_stoer<Container>{ATOL, RTOL};
+  // the Lyapunov estimate of the task as of its last accepted step
+  double exponent = 0;
+
+  size_t renorms = 0;
+
+  auto report = [&](ReturnFlag flag, double time, auto const &state) {
+    auto const data = hybrid.output(state);
+
+    writer.flush();
+
+    if (summarized) {
+      summary.add(data);
+    }
+
+    if (triage && triage->record(task_id, flag, time, t_end, a_in_init, summary, stats.rhs_calls)) {
+      trajectory.close();
+      return flag;
+    }
+
+    if (flag == ReturnFlag::max_iter) {
+      log << std::to_string(task_id) + ":Max iteration number reaches!\n";
+      log.flush();
+    }
+
+    if (archive) {
+      archive->append(worker, task_id, trajectory.buffer, flag, time, data);
+    }
+
+    if (flag == ReturnFlag::finish || flag == ReturnFlag::event || flag == ReturnFlag::quiescent) {
+      output << last_state_row(task_id, time, data);
+      output.flush();
+    }
+
+    stats_file << stats_row(task_id, flag, stats);
+    stats_file.flush();
+
+    if (ensemble) {
+      ensemble->record(worker, flag, time, t_end, summary);
+    }
+
+    if (lyapunov) {
+      lyapunov->record(task_id, flag, time, exponent, renorms);
+    }
 
-  secular::Stream_observer writer{f_out, out_dt};
+    trajectory.close();
+    return flag;
+  };
 
   secular::SMA_Determinator stop{const_parameters.a_in_coef(), a_in_init * ctrl.GW_in_ratio};
 
-  auto func = secular::Dynamic_dispatch<Container>(ctrl, const_parameters);
-  writer(data, time);
+  secular::Event_detector events{EVENTS, const_parameters, ctrl.ave_method, a_in_init};
 
-  // STATIC_DISPATH(ctrl, const_parameters,
+  return secular::static_dispatch(ctrl, [&](auto const &static_ctrl) {
+    using Ctrl = std::decay_t<decltype(static_ctrl)>;
 
-  for (; time <= t_end && !stop(data, time);) {
-    constexpr size_t max_attempts = 500;
+    using Container = typename Ctrl::Container;
 
-    controlled_step_result res = success;
-    size_t trials = 0;
-    do {
-      res = stepper.try_step(func, data, time, dt);
-      trials++;
-    } while ((res == fail) && (trials < max_attempts));
+    Container data;
 
-    if (trials == max_attempts) {
-      return ReturnFlag::max_iter;
+    double dt = 0;
+
+    double time = 0;
+
+    if (resume) {
+      secular::restore(*resume, data, time, dt);
+      writer.resume(resume->t_out);
+    } else {
+      initialize_orbit_args(ctrl.ave_method, data, init_args.begin() + ARGS_OFFSET);
+      writer(data, time);
     }
-    writer(data, time);
-  }
-  //)
 
-  output << PACK(task_id, ' ', time, ' ', data, "\r\n");
-  output.flush();
+    if (summarized) {
+      summary.add(data);
+    }
+
+    // a resumed task has already reported what held at its start
+    if (events.on()) {
+      auto const hits = events.reset(data, time);
+      if (!resume && log_events(log, task_id, hits)) {
+        return report(ReturnFlag::event, time, data);
+      }
+    }
+
+    if (time <= t_end && propagate_analytic(ctrl, const_parameters, data, time, t_end, writer, summary)) {
+      return report(ReturnFlag::finish, time, data);
+    }
+
+    secular::Quiescence_detector quiescence{QUIESCENCE, ctrl, const_parameters, init_args.begin() + ARGS_OFFSET, time};
+
+    // adds the accepted step to the summary; true when stage 1 of a triage has seen enough to hand the task over,
+    // which ends it like an event
+    auto handed_over = [&]() {
+      if (!summarized) return false;
+      summary.add(hybrid.output(data));
+      return triage && triage->crossed(summary, a_in_init);
+    };
+
+    // true when the task has gone quiescent and was carried as far as it goes
+    auto quiescent = [&]() {
+      if (!quiescence(hybrid.output(data), time)) return false;
+      extrapolate_quiescent(ctrl, const_parameters, data, time, t_end, writer, summary);
+      return true;
+    };
+
+    auto static_func = secular::Dynamic_dispatch<Container, Ctrl>(static_ctrl, const_parameters);
+
+    bool const dense_out = DENSE && secular::is_on(out_dt);
+
+    // a hybrid task that starts where the double average does not hold starts in SA
+    bool const SA_start = hybrid.update(data, time);
+
+    secular::Orbit_projector projector{const_parameters};
+
+    stats.projecting = PROJECTION;
+
+    // true when the state was projected and the stepper has to continue from the new one
+    auto project = [&]() {
+      if (!PROJECTION) return false;
+      double const correction =
+          projector(data, hybrid.SA() ? secular::LK_method::SA : ctrl.ave_method, PROJECTION_TOL);
+      if (correction == 0) return false;
+      stats.project(correction);
+      return true;
+    };
+
+    // true when the run is being terminated and the task has to give up after its snapshot
+    auto snapshot = [&]() {
+      if (!checkpoint->due(worker)) return false;
+
+      Container const state = hybrid.output(data);
+
+      checkpoint->save(worker, {secular::Task_checkpoint{task_id, time, dt, writer.next_time(), trajectory.save(),
+                                                         std::vector<double>(state.begin(), state.end())}});
+      return secular::Checkpoint::terminated();
+    };
+
+    // runs the task on the RHS func, which counts its calls
+    auto integrate = [&](auto &func) {
+      if (dt <= 0) {
+        dt = secular::initial_step(STEPPER, STEPPER.type, func, data, time, ATOL, RTOL);
+      }
+
+      if (SA_start) {
+        dt = std::min(dt, hybrid.SA_step(data));
+      }
+
+      if (lyapunov) {
+        using Func = std::remove_reference_t<decltype(func)>;
+
+        secular::Tangent_system<Container, Func> tangent{func, data, task_id, ATOL, LYAPUNOV.tol};
+
+        auto y = tangent.pack(data, time);
+
+        using State = typename decltype(tangent)::State;
+
+        return secular::controlled_stepper_dispatch<State>(STEPPER, ATOL, RTOL, [&](auto stepper) {
+          for (; time <= t_end && !stop(data, time);) {
+            controlled_step_result res = success;
+            size_t trials = 0;
+            do {
+              double const t_start = time;
+              res = stepper.try_step(std::ref(tangent), y, time, dt);
+              trials++;
+              if (res == fail) {
+                stats.reject();
+              } else {
+                stats.accept(time - t_start);
+              }
+            } while ((res == fail) && (trials < MAX_ATTEMPTS));
+
+            tangent.unpack(y, data);
+
+            exponent = tangent.exponent(y, time), renorms = tangent.renorms();
+
+            if (trials == MAX_ATTEMPTS) {
+              return report(ReturnFlag::max_iter, time, data);
+            }
+            writer(data, time);
+
+            if (handed_over()) return report(ReturnFlag::event, time, data);
+
+            if (quiescent()) return report(ReturnFlag::quiescent, time, data);
+
+            if (project()) {
+              std::copy(data.begin(), data.end(), y.begin());
+              secular::state_moved(stepper);
+            } else if (tangent.renormalize(y, LYAPUNOV.renorm)) {
+              secular::state_moved(stepper);
+            }
+
+            if (snapshot()) return ReturnFlag::interrupt;
+          }
+          return report(ReturnFlag::finish, time, data);
+        });
+      } else if (dense_out || events.on()) {
+        return secular::dense_stepper_dispatch<Container>(STEPPER, ATOL, RTOL, [&](auto stepper) {
+          stepper.initialize(data, time, dt);
+
+          stats.rejects_counted = false;
+
+          Container sample;
+
+          // the dense output of the last step in the form the trajectory and the events see
+          auto interp = [&](double t, Container &x) {
+            stepper.calc_state(t, x);
+            hybrid.to_output(x);
+          };
+
+          for (; time <= t_end && !stop(data, time);) {
+            try {
+              stepper.do_step(func);
+            } catch (step_adjustment_error const &) {
+              return report(ReturnFlag::max_iter, time, data);
+            }
+
+            double t_upto = stepper.current_time();
+
+            stats.accept(t_upto - time);
 
-  return ReturnFlag::finish;
+            data = stepper.current_state();
+
+            auto const hits = events.check(time, t_upto, hybrid.output(data), interp);
+
+            bool const stopped = log_events(log, task_id, hits);
+
+            if (stopped) {
+              t_upto = hits.back().time;
+              stepper.calc_state(t_upto, data);
+            }
+
+            if (dense_out) {
+              writer(sample, t_upto, interp);
+            } else {
+              writer(hybrid.output(data), t_upto);
+            }
+
+            time = t_upto;
+            dt = stepper.current_time_step();
+
+            if (stopped) return report(ReturnFlag::event, time, data);
+
+            if (handed_over()) return report(ReturnFlag::event, time, data);
+
+            if (quiescent()) return report(ReturnFlag::quiescent, time, data);
+
+            if (hybrid.update(data, time)) {
+              projector.reset();
+              dt = hybrid.SA() ? std::min(dt, hybrid.SA_step(data)) : dt;
+              stepper.initialize(data, time, dt);
+            } else if (project()) {
+              stepper.initialize(data, time, dt);
+            }
+
+            if (snapshot()) return ReturnFlag::interrupt;
+          }
+          return report(ReturnFlag::finish, time, data);
+        });
+      } else {
+        return secular::controlled_stepper_dispatch<Container>(STEPPER, ATOL, RTOL, [&](auto stepper) {
+          for (; time <= t_end && !stop(data, time);) {
+            controlled_step_result res = success;
+            size_t trials = 0;
+            do {
+              double const t_start = time;
+              res = stepper.try_step(func, data, time, dt);
+              trials++;
+              if (res == fail) {
+                stats.reject();
+              } else {
+                stats.accept(time - t_start);
+              }
+            } while ((res == fail) && (trials < MAX_ATTEMPTS));
+
+            if (trials == MAX_ATTEMPTS) {
+              return report(ReturnFlag::max_iter, time, data);
+            }
+            writer(hybrid.output(data), time);
+
+            if (handed_over()) return report(ReturnFlag::event, time, data);
+
+            if (quiescent()) return report(ReturnFlag::quiescent, time, data);
+
+            if (hybrid.update(data, time)) {
+              projector.reset();
+              dt = hybrid.SA() ? std::min(dt, hybrid.SA_step(data)) : dt;
+              secular::restart(stepper);
+            } else if (project()) {
+              secular::state_moved(stepper);
+            }
+
+            if (snapshot()) return ReturnFlag::interrupt;
+          }
+          return report(ReturnFlag::finish, time, data);
+        });
+      }
+    };
+
+    // hybrid tasks start in DA; only they pay for the switch to the SA kernel, in their RHS calls and in its code
+    if constexpr (Ctrl::ave_method == secular::LK_method::DA) {
+      if (ctrl.hybrid) {
+        using SA_Ctrl = typename Ctrl::template with_method<secular::LK_method::SA>;
+
+        SA_Ctrl const SA_ctrl{ctrl};
+
+        auto SA_func = secular::Dynamic_dispatch<Container, SA_Ctrl>(SA_ctrl, const_parameters);
+
+        auto func = [&](Container const &x, Container &dxdt, double t) {
+          stats.rhs_calls++;
+          if (hybrid.SA()) {
+            SA_func(x, dxdt, t);
+          } else {
+            static_func(x, dxdt, t);
+          }
+        };
+
+        return integrate(func);
+      }
+    }
+
+    auto func = [&](Container const &x, Container &dxdt, double t) {
+      stats.rhs_calls++;
+      static_func(x, dxdt, t);
+    };
+
+    return integrate(func);
+  });
 }
 
-void single_thread_job(Controller const &ctrl, std::string work_dir, ConcurrentFile input, ConcurrentFile output,
-                       ConcurrentFile log) {
-  std::string entry;
-  for (; input.execute(get_line, entry);) {
-    size_t task_id = static_cast<size_t>(std::stoi(entry));
+struct Batch_lane {
+  size_t task_id{0};
+  double t_end{0};
+  Trajectory trajectory;
+  std::unique_ptr<secular::Stream_observer> writer;
+  std::unique_ptr<secular::SMA_Determinator> stop;
+  std::unique_ptr<secular::Event_detector> events;
+  std::unique_ptr<secular::Orbit_projector> projector;
+  std::unique_ptr<secular::Quiescence_detector> quiescence;
+  secular::SecularConst args;
+  secular::Orbit_summary summary;
+  double a_in_init{0};
+  secular::Task_stats stats;
+  double time{0};
+};
 
-    std::vector<double> v;
+template <typename Ctrl>
+void batch_thread_job(Ctrl const &static_ctrl, Controller const &ctrl, std::string const &work_dir,
+                      TaskPool pool, Archive archive, CheckpointPtr checkpoint, TriagePtr triage, EnsemblePtr ensemble,
+                      ConcurrentFile output, ConcurrentFile log, ConcurrentFile stats_file) {
+  constexpr size_t Lanes = secular::simd_lanes;
 
-    secular::unpack_args_from_str(entry, v, PARAMETER_NUM);
+  using Container = typename Ctrl::Container;
 
-    ReturnFlag res = call_ode_int(work_dir, output, ctrl, v);
+  auto stepper = std::make_unique<secular::Batch_stepper<Ctrl, Lanes>>(static_ctrl, ATOL, RTOL, STEPPER);
 
-    if (res == ReturnFlag::max_iter) {
-      log << std::to_string(task_id) + ":Max iteration number reaches!\n";
+  std::array<Batch_lane, Lanes> lanes;
+
+  size_t const worker = pool->register_worker();
+
+  std::vector<double> v;
+
+  bool const summarized = triage || ensemble;
+
+  auto finish = [&](size_t l, ReturnFlag flag, Container const &data, double time) {
+    Batch_lane &lane = lanes[l];
+
+    lane.stats.rhs_calls = stepper->active()[l] ? stepper->rhs_calls(l) : 0;
+
+    lane.writer->flush();
+
+    if (summarized) {
+      lane.summary.add(data);
+    }
+
+    if (triage &&
+        triage->record(lane.task_id, flag, time, lane.t_end, lane.a_in_init, lane.summary, lane.stats.rhs_calls)) {
+      lane.trajectory.close();
+      return;
+    }
+
+    if (flag == ReturnFlag::max_iter) {
+      log << std::to_string(lane.task_id) + ":Max iteration number reaches!\n";
       log.flush();
     }
+
+    if (archive) {
+      archive->append(worker, lanes[l].task_id, lanes[l].trajectory.buffer, flag, time, data);
+    }
+
+    if (flag == ReturnFlag::finish || flag == ReturnFlag::event || flag == ReturnFlag::quiescent) {
+      output << last_state_row(lanes[l].task_id, time, data);
+      output.flush();
+    }
+
+    stats_file << stats_row(lanes[l].task_id, flag, lanes[l].stats);
+    stats_file.flush();
+
+    if (ensemble) {
+      ensemble->record(worker, flag, time, lane.t_end, lane.summary);
+    }
+
+    lanes[l].trajectory.close();
+  };
+
+  // pull the next task into lane l, or leave the lane idle when the pool is exhausted.
+  auto refill = [&](size_t l) {
+    stepper->deactivate(l);
+
+    for (; pool->pop(worker, v);) {
+      auto [task_id, t_end, out_dt] = secular::cast_unpack<decltype(v.begin()), size_t, double, double>(v.begin());
+
+      auto const [m1, m2, m3, a_in_init] = secular::unpack_args<4>(v.begin() + ARGS_OFFSET);
+
+      Batch_lane &lane = lanes[l];
+
+      lane.task_id = task_id;
+
+      lane.t_end = t_end;
+
+      lane.stats = secular::Task_stats{};
+
+      lane.stats.projecting = PROJECTION;
+
+      lane.a_in_init = a_in_init;
+
+      auto const *resume = checkpoint->find(task_id);
+
+      lane.trajectory.open(work_dir, ctrl, task_id, secular::is_on(out_dt), archive, resume);
+
+      secular::SecularConst const_parameters{m1, m2, m3};
+
+      lane.summary = secular::Orbit_summary{const_parameters.a_in_coef(), ctrl.ave_method == secular::LK_method::SA};
+
+      lane.writer = std::make_unique<secular::Stream_observer>(*lane.trajectory.os, out_dt, OUTPUT_TYPE, OUTPUT, t_end);
+
+      lane.stop =
+          std::make_unique<secular::SMA_Determinator>(const_parameters.a_in_coef(), a_in_init * ctrl.GW_in_ratio);
+
+      lane.events = std::make_unique<secular::Event_detector>(EVENTS, const_parameters, ctrl.ave_method, a_in_init);
+
+      lane.projector = std::make_unique<secular::Orbit_projector>(const_parameters);
+
+      Container data;
+
+      double time = 0;
+
+      double dt = 0;
+
+      if (resume) {
+        secular::restore(*resume, data, time, dt);
+        lane.writer->resume(resume->t_out);
+      } else {
+        initialize_orbit_args(ctrl.ave_method, data, v.begin() + ARGS_OFFSET);
+        (*lane.writer)(data, time);
+      }
+
+      if (summarized) {
+        lane.summary.add(data);
+      }
+
+      if (lane.events->on()) {
+        auto const hits = lane.events->reset(data, time);
+        if (!resume && log_events(log, task_id, hits)) {
+          finish(l, ReturnFlag::event, data, time);
+          continue;
+        }
+      }
+
+      lane.time = time;
+
+      if (time <= t_end && propagate_analytic(ctrl, const_parameters, data, time, t_end, *lane.writer, lane.summary)) {
+        finish(l, ReturnFlag::finish, data, time);
+        continue;
+      }
+
+      if (time > t_end || (*lane.stop)(data, time)) {
+        finish(l, ReturnFlag::finish, data, time);
+        continue;
+      }
+
+      lane.args = const_parameters;
+
+      lane.quiescence = std::make_unique<secular::Quiescence_detector>(QUIESCENCE, ctrl, const_parameters,
+                                                                       v.begin() + ARGS_OFFSET, time);
+
+      if (dt <= 0) {
+        auto func = secular::Dynamic_dispatch<Container, Ctrl>(static_ctrl, const_parameters);
+        dt = secular::initial_step(STEPPER, secular::Stepper_type::DP5, func, data, time, ATOL, RTOL);
+      }
+
+      stepper->load(l, data, const_parameters, time, dt);
+      return;
+    }
+  };
+
+  for (size_t l = 0; l < Lanes; ++l) {
+    refill(l);
+  }
+
+  for (; stepper->any_active();) {
+    stepper->try_step();
+
+    for (size_t l = 0; l < Lanes; ++l) {
+      if (!stepper->active()[l]) continue;
+
+      if (stepper->accepted()[l]) {
+        Batch_lane &lane = lanes[l];
+
+        double time = stepper->time(l);
+
+        lane.stats.accept(time - lane.time);
+
+        Container data = stepper->state(l);
+
+        if (summarized) {
+          lane.summary.add(data);
+        }
+
+        auto interp = [&](double t, Container &x) { stepper->interpolate(l, t, x); };
+
+        bool stopped = false;
+
+        if (lane.events->on()) {
+          auto const hits = lane.events->check(lane.time, time, data, interp);
+
+          stopped = log_events(log, lane.task_id, hits);
+
+          if (stopped) {
+            time = hits.back().time;
+            interp(time, data);
+          }
+        }
+
+        lane.time = time;
+
+        if (DENSE) {
+          Container sample;
+          (*lane.writer)(sample, time, interp);
+        } else {
+          (*lane.writer)(data, time);
+        }
+
+        if (stopped) {
+          finish(l, ReturnFlag::event, data, time);
+          refill(l);
+        } else if (time > lane.t_end || (*lane.stop)(data, time)) {
+          finish(l, ReturnFlag::finish, data, time);
+          refill(l);
+        } else if (triage && triage->crossed(lane.summary, lane.a_in_init)) {
+          finish(l, ReturnFlag::event, data, time);
+          refill(l);
+        } else if ((*lane.quiescence)(data, time)) {
+          extrapolate_quiescent(ctrl, lane.args, data, time, lane.t_end, *lane.writer, lane.summary);
+          finish(l, ReturnFlag::quiescent, data, time);
+          refill(l);
+        } else if (PROJECTION) {
+          double const correction = (*lane.projector)(data, ctrl.ave_method, PROJECTION_TOL);
+          if (correction > 0) {
+            lane.stats.project(correction);
+            stepper->move(l, data);
+          }
+        }
+      } else {
+        lanes[l].stats.reject();
+
+        if (stepper->rejects(l) >= MAX_ATTEMPTS || stepper->stalled(l)) {
+          finish(l, ReturnFlag::max_iter, stepper->state(l), stepper->time(l));
+          refill(l);
+        }
+      }
+    }
+
+    if (checkpoint->due(worker)) {
+      std::vector<secular::Task_checkpoint> tasks;
+
+      for (size_t l = 0; l < Lanes; ++l) {
+        if (!stepper->active()[l]) continue;
+
+        Container const data = stepper->state(l);
+
+        tasks.emplace_back(secular::Task_checkpoint{lanes[l].task_id, stepper->time(l), stepper->step_size(l),
+                                                    lanes[l].writer->next_time(), lanes[l].trajectory.save(),
+                                                    std::vector<double>(data.begin(), data.end())});
+      }
+
+      checkpoint->save(worker, tasks);
+
+      if (secular::Checkpoint::terminated()) {
+        return;
+      }
+    }
+  }
+}
+
+void single_thread_job(Controller const &ctrl, std::string work_dir, TaskPool pool, Archive archive,
+                       CheckpointPtr checkpoint, TriagePtr triage, EnsemblePtr ensemble, LyapunovPtr lyapunov,
+                       ConcurrentFile output, ConcurrentFile log, ConcurrentFile stats) {
+  if (BATCH) {
+    secular::static_dispatch(ctrl, [&](auto const &static_ctrl) {
+      batch_thread_job(static_ctrl, ctrl, work_dir, pool, archive, checkpoint, triage, ensemble, output, log, stats);
+    });
+    return;
+  }
+
+  size_t const worker = pool->register_worker();
+
+  std::vector<double> v;
+
+  for (; !secular::Checkpoint::terminated() && pool->pop(worker, v);) {
+    ReturnFlag res =
+        call_ode_int(work_dir, output, log, stats, ctrl, v, archive, checkpoint, triage, ensemble, lyapunov, worker);
+
+    if (res == ReturnFlag::interrupt) {
+      return;
+    }
+  }
+}
+
+/* true if the state a task restarts from already meets the GW_in stop of row v, as the final state of a merger does */
+bool merged(Controller const &ctrl, double const *v, secular::Task_checkpoint const &task) {
+  if (!ctrl.GW_in || task.state.size() < 6) return false;
+
+  auto const [m1, m2, m3, a_in_init] = secular::unpack_args<4>(v + ARGS_OFFSET);
+
+  auto const &x = task.state;
+
+  secular::SecularConst const args{m1, m2, m3};
+
+  double const a_in = secular::calc_a(args.a_in_coef(), x[0], x[1], x[2], x[3], x[4], x[5]);
+
+  return a_in <= ctrl.GW_in_ratio * a_in_init;
+}
+
+/* true if the task of row v is left to run; its estimated cost, for the part it has left, is then added to cost */
+bool admit_task(Controller const &ctrl, secular::Restart_table const &restart, double const *v,
+                std::vector<double> &cost) {
+  size_t const task_id = static_cast<size_t>(v[0]);
+
+  double const t_end = v[1];
+
+  if (restart.done(task_id)) return false;
+
+  auto const *resume = restart.find(task_id);
+
+  double const t_start = resume ? resume->time : 0;
+
+  if (t_start > t_end) return false;
+
+  // a task that merged before its old t_end stays done: continued, it would only stop again at once
+  if (resume && merged(ctrl, v, *resume)) return false;
+
+  double const left = t_end > 0 ? (t_end - t_start) / t_end : 0;
+
+  cost.emplace_back(secular::estimate_cost(ctrl, v) * left);
+
+  return true;
+}
+
+using Task_select = std::function<bool(size_t)>;
+
+auto load_tasks(Controller const &ctrl, std::string const &input_file_path, secular::Restart_table const &restart,
+                Task_select const &select) {
+  secular::Input_table input{input_file_path, PARAMETER_NUM};
+
+  std::vector<double> cost;
+
+  cost.reserve(input.size());
+
+  input.filter([&](double const *v) {
+    return select(static_cast<size_t>(v[0])) && admit_task(ctrl, restart, v, cost);
+  });
+
+  return std::make_tuple(input.release(), std::move(cost));
+}
+
+/* the ids of the sampled tasks left to run and their costs; the rows themselves are drawn again when popped */
+auto sample_tasks(Controller const &ctrl, secular::Population const &population,
+                  secular::Restart_table const &restart, Task_select const &select) {
+  std::vector<size_t> ids;
+
+  std::vector<double> cost;
+
+  std::vector<double> row(PARAMETER_NUM);
+
+  for (size_t task_id = population.first(); task_id < population.first() + population.size(); ++task_id) {
+    if (!select(task_id)) continue;
+
+    population.sample(task_id, row.data());
+
+    if (admit_task(ctrl, restart, row.data(), cost)) {
+      ids.emplace_back(task_id);
+    }
   }
+  return std::make_tuple(std::move(ids), std::move(cost));
 }
 
-size_t decide_thread_num(std::string const &user_specified_core_num, std::string const &input_file_path) {
-  std::ifstream input_file{input_file_path};
+/*
+ * The tasks of the input, or of the population, that select(task_id) keeps and that are left to run, dealt to
+ * worker_num(number of tasks) workers.
+ */
+template <typename Workers>
+TaskPool make_pool(Controller const &ctrl, secular::Population const &population, std::string const &input_file_name,
+                   secular::Restart_table const &restart, Task_select const &select, Workers &&worker_num) {
+  if (population.size() > 0) {
+    auto [ids, cost] = sample_tasks(ctrl, population, restart, select);
+
+    auto generate = [population](size_t task_id, double *row) { population.sample(task_id, row); };
 
-  size_t task_num = std::count(std::istreambuf_iterator<char>(input_file), std::istreambuf_iterator<char>(), '\n');
+    return std::make_shared<secular::Task_pool>(generate, std::move(ids), PARAMETER_NUM, cost, worker_num(cost.size()));
+  } else {
+    auto [rows, cost] = load_tasks(ctrl, input_file_name, restart, select);
 
+    return std::make_shared<secular::Task_pool>(std::move(rows), PARAMETER_NUM, cost, worker_num(cost.size()));
+  }
+}
+
+size_t decide_thread_num(std::string const &user_specified_core_num, size_t task_num) {
   size_t cpu_num = space::multi_thread::machine_thread_num;
 
   if (user_specified_core_num != "auto") {
@@ -149,15 +1043,60 @@ int main(int argc, char **argv) {
 
   RTOL = cfg.get<double>("relative_tolerance");
 
-  work_dir = cfg.get<std::string>("output_dir");
+  // the lanes of a batch share one kernel, so hybrid tasks, which change their averaging on the way, run scalar
+  BATCH = secular::str_to_bool(secular::get_optional<std::string>(cfg, "batch", "off")) && !ctrl.hybrid;
 
-  input_file_name = cfg.get<std::string>("input");
+  DENSE = secular::str_to_bool(secular::get_optional<std::string>(cfg, "dense_output", "off"));
 
-  user_specified_core_num = cfg.get<std::string>("cpu_num");
+  PROJECTION = secular::str_to_bool(secular::get_optional<std::string>(cfg, "projection", "off"));
 
-  size_t thread_num = decide_thread_num(user_specified_core_num, input_file_name);
+  PROJECTION_TOL = secular::get_optional<double>(cfg, "projection_tol", 10 * RTOL);
 
-  std::cout << thread_num << " thread(s) will be created for calculation." << std::endl;
+  EVENTS = secular::Event_config{cfg};
+
+  QUIESCENCE = secular::Quiescence_config{cfg};
+
+  TRIAGE = secular::Triage_config{cfg};
+
+  ENSEMBLE = secular::Ensemble_config{cfg};
+
+  LYAPUNOV = secular::Lyapunov_config{cfg};
+
+  // the tangent vector runs on the scalar controlled steppers only, and its length is set by the absolute tolerance
+  if (LYAPUNOV.on && (ctrl.hybrid || EVENTS.any() || DENSE || ATOL <= 0)) {
+    throw ReturnFlag::input_err;
+  }
+
+  BATCH = BATCH && !LYAPUNOV.on;
+
+  ANALYTIC = secular::str_to_analytic_mode(secular::get_optional<std::string>(cfg, "analytic", "auto"));
+
+  STEPPER = secular::Stepper_config{cfg};
+
+  // dense output and the events run on the dense-output steppers, which odeint has for BS and DP5 only
+  if ((DENSE || EVENTS.any()) && !STEPPER.has_dense_output()) {
+    throw ReturnFlag::input_err;
+  }
+
+  OUTPUT_TYPE = secular::str_to_output_type(secular::get_optional<std::string>(cfg, "output_type", "text"));
+
+  OUTPUT = secular::Output_config{cfg};
+
+  bool const archived = secular::str_to_bool(secular::get_optional<std::string>(cfg, "archive", "off"));
+
+  auto const restart_mode = secular::str_to_restart_mode(secular::get_optional<std::string>(cfg, "restart", "off"));
+
+  double const checkpoint_interval = secular::get_optional<double>(cfg, "checkpoint_interval", 0.0);
+
+  work_dir = cfg.get<std::string>("output_dir");
+
+  secular::Population const population{cfg};
+
+  if (population.size() == 0) {
+    input_file_name = cfg.get<std::string>("input");
+  }
+
+  user_specified_core_num = cfg.get<std::string>("cpu_num");
 
   const int dir_err = system(("mkdir -p " + work_dir).c_str());
   if (dir_err == -1) {
@@ -167,18 +1106,102 @@ int main(int argc, char **argv) {
 
   work_dir += "/";
 
-  auto input_file = make_thread_safe_fstream(input_file_name, std::fstream::in);
+  secular::Restart_table restart{work_dir, restart_mode};
+
+  bool const append = restart_mode != secular::Restart_mode::off;
+
+  TriagePtr triage =
+      TRIAGE.on ? std::make_shared<secular::Triage>(work_dir, TRIAGE, EVENTS, ctrl.GW_in_ratio, append) : nullptr;
 
-  auto output_file = make_thread_safe_fstream(work_dir + "last_state.txt", std::fstream::out);
+  // tasks an earlier run handed over to stage 2 skip stage 1, but count for the threads
+  size_t const handed_over = triage ? triage->handed_over().size() : 0;
+
+  size_t thread_num = 0;
+
+  TaskPool pool = make_pool(
+      ctrl, population, input_file_name, restart, [&](size_t id) { return !triage || !triage->handed_over(id); },
+      [&](size_t task_num) { return thread_num = decide_thread_num(user_specified_core_num, task_num + handed_over); });
+
+  std::cout << thread_num << " thread(s) will be created for calculation." << std::endl;
+
+  auto const mode = append ? std::fstream::out | std::fstream::app : std::fstream::out;
+
+  auto output_file = make_thread_safe_fstream(work_dir + "last_state.txt", mode);
+
+  auto log_file = make_thread_safe_fstream(work_dir + "log.txt", mode);
+
+  auto stats_file = make_thread_safe_fstream(work_dir + "stats.txt", mode);
+
+  if (!append) {
+    stats_file << "#task_id flag rhs_calls wall_time[s] accepted rejected dt_min[yr] dt_median[yr] dt_max[yr] "
+                  "projections max_projection dt_histogram(log10_dt:steps)\r\n";
+    stats_file.flush();
+  }
 
-  auto log_file = make_thread_safe_fstream(work_dir + "log.txt", std::fstream::out);
+  Archive archive =
+      archived ? std::make_shared<secular::Task_archive>(work_dir, thread_num, OUTPUT_TYPE, append) : nullptr;
+
+  auto checkpoint =
+      std::make_shared<secular::Checkpoint>(work_dir, thread_num, checkpoint_interval, std::move(restart));
+
+  // 'continue' runs finished tasks again, so only 'resume' adds to the ensemble of the run before
+  EnsemblePtr ensemble =
+      ENSEMBLE.on ? std::make_shared<secular::Ensemble>(work_dir, ENSEMBLE, thread_num,
+                                                         restart_mode == secular::Restart_mode::resume)
+                  : nullptr;
+
+  LyapunovPtr lyapunov = LYAPUNOV.on ? std::make_shared<secular::Lyapunov>(work_dir, append) : nullptr;
 
   log_file << secular::get_log_title(ctrl) + "\r\n";
   log_file.flush();
 
+  double const atol = ATOL, rtol = RTOL;
+
+  if (triage) {
+    ATOL = RTOL = TRIAGE.tol;
+  }
+
   space::tools::Timer timer;
   timer.start();
-  space::multi_thread::multi_thread(thread_num, single_thread_job, ctrl, work_dir, input_file, output_file, log_file);
+  space::multi_thread::multi_thread(thread_num, single_thread_job, ctrl, work_dir, pool, archive, checkpoint, triage,
+                                    ensemble, lyapunov, output_file, log_file, stats_file);
+
+  if (triage && !secular::Checkpoint::terminated()) {
+    // a handed-over task resumes in stage 2 only from a stage-2 snapshot, and starts afresh from a stage-1 one
+    for (auto id : triage->handed_over()) {
+      auto const *task = checkpoint->find(id);
+      if (task && task->stage == 1) {
+        checkpoint->forget(id);
+      }
+    }
+
+    checkpoint->begin_stage(2);
+
+    ATOL = atol, RTOL = rtol;
+
+    pool = make_pool(
+        ctrl, population, input_file_name, checkpoint->restart(), [&](size_t id) { return triage->handed_over(id); },
+        [&](size_t) { return thread_num; });
+
+    std::cout << pool->size() << " task(s) handed over to stage 2." << std::endl;
+
+    space::multi_thread::multi_thread(thread_num, single_thread_job, ctrl, work_dir, pool, archive, checkpoint,
+                                      TriagePtr{}, ensemble, lyapunov, output_file, log_file, stats_file);
+  }
+
+  if (archive) {
+    archive->write_index();
+  }
+
+  if (ensemble) {
+    ensemble->write();
+  }
+
+  if (secular::Checkpoint::terminated()) {
+    std::cout << "\r\n Terminated, the tasks in flight are checkpointed; rerun with 'restart = resume'.\n";
+  } else {
+    checkpoint->clear();
+  }
   std::cout << "\r\n Time:" << timer.get_time() << " s\n";
   return 0;
 }
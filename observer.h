@@ -3,25 +3,328 @@
 #ifndef SECULAR_OBSERVER_
 #define SECULAR_OBSERVER_
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+#include "orbit_context.h"
 #include "tools.h"
 namespace secular {
+
+enum class Output_type { text, binary };
+
+Output_type str_to_output_type(std::string const& key) {
+  if (case_insens_equals(key, "text") || case_insens_equals(key, "txt")) {
+    return Output_type::text;
+  } else if (case_insens_equals(key, "binary") || case_insens_equals(key, "bin")) {
+    return Output_type::binary;
+  } else {
+    throw ReturnFlag::input_err;
+  }
+}
+
+/*
+ * Binary trajectory file, host byte order:
+ *   char[8]   magic "SECULAR1"
+ *   uint64    header size in bytes; a multiple of 8, the records start right after it
+ *   uint64    task id
+ *   uint64    columns per record (t + state)
+ *   uint64    title length, then the title (get_log_title)
+ *   uint64    column-name length, then the names (Controller::output_format)
+ *   zero padding up to the header size
+ * followed by fixed-width records of `columns` doubles.
+ */
+constexpr char binary_magic[8] = {'S', 'E', 'C', 'U', 'L', 'A', 'R', '1'};
+
+void write_binary_header(std::ostream& os, size_t task_id, size_t columns, std::string const& title,
+                         std::string const& names) {
+  auto put = [&](uint64_t x) { os.write(reinterpret_cast<char const*>(&x), sizeof(x)); };
+
+  uint64_t const raw_size = sizeof(binary_magic) + 5 * sizeof(uint64_t) + title.size() + names.size();
+
+  uint64_t const header_size = (raw_size + 7) / 8 * 8;
+
+  os.write(binary_magic, sizeof(binary_magic));
+  put(header_size);
+  put(task_id);
+  put(columns);
+  put(title.size());
+  os.write(title.data(), title.size());
+  put(names.size());
+  os.write(names.data(), names.size());
+
+  for (size_t i = raw_size; i < header_size; ++i) {
+    os.put('\0');
+  }
+}
+
+enum class Output_policy { fixed, log, extrema };
+
+Output_policy str_to_output_policy(std::string const& key) {
+  if (case_insens_equals(key, "fixed")) {
+    return Output_policy::fixed;
+  } else if (case_insens_equals(key, "log")) {
+    return Output_policy::log;
+  } else if (case_insens_equals(key, "extrema")) {
+    return Output_policy::extrema;
+  } else {
+    throw ReturnFlag::input_err;
+  }
+}
+
+/*
+ * When a trajectory is written, 'output_policy =':
+ *   fixed    every out_dt (default);
+ *   log      at the start and at out_dt r^k, k = 0, 1, ..., with output_per_decade (10) times per decade;
+ *   extrema  at the start and at the local maxima and minima of e_in; out_dt only switches the output on. An
+ *            extremum counts once e_in has moved away from it by output_extrema_tol (1e-6), which keeps the noise of
+ *            a flat e_in out. It is taken at the end of an accepted step, or on the dense output of the step after
+ *            it with dense_output on; tasks carried in closed form are written at their exact extrema.
+ * 'output_budget = N' caps the points of a task, the first one aside, at about N (0, no cap). fixed and log stretch
+ * their spacing so that N points span t_end; extrema splits [0, t_end] into N slots and keeps the maximum of e_in
+ * with the largest e_in in each, dropping the minima.
+ */
+struct Output_config {
+  Output_config() = default;
+
+  template <typename Config>
+  explicit Output_config(Config& cfg) {
+    policy = str_to_output_policy(get_optional<std::string>(cfg, "output_policy", "fixed"));
+
+    per_decade = get_optional<double>(cfg, "output_per_decade", 10.0);
+
+    budget = get_optional<size_t>(cfg, "output_budget", 0);
+
+    extrema_tol = get_optional<double>(cfg, "output_extrema_tol", 1e-6);
+
+    if (per_decade <= 0 || extrema_tol < 0) {
+      throw ReturnFlag::input_err;
+    }
+  }
+
+  Output_policy policy{Output_policy::fixed};
+  double per_decade{10};
+  size_t budget{0};
+  double extrema_tol{1e-6};
+};
+
 struct Stream_observer {
-  Stream_observer(std::ostream& out, double dt) : dt_{dt}, t_out_{0.0}, f_out_{out}, switch_{secular::is_on(dt)} {}
+  Stream_observer(std::ostream& out, double dt, Output_type type = Output_type::text, Output_config const& cfg = {},
+                  double t_end = 0)
+      : dt_{cfg.policy == Output_policy::fixed && cfg.budget > 0 ? std::max(dt, t_end / cfg.budget) : dt},
+        t_out_{0.0},
+        f_out_{out},
+        switch_{secular::is_on(dt)},
+        type_{type},
+        policy_{cfg.policy},
+        tol_{cfg.extrema_tol} {
+    if (policy_ == Output_policy::log) {
+      ratio_ = pow(10, 1 / cfg.per_decade);
+      if (cfg.budget > 0 && t_end > dt) {
+        ratio_ = std::max(ratio_, pow(t_end / dt, 1.0 / cfg.budget));
+      }
+    } else if (policy_ == Output_policy::extrema && cfg.budget > 0) {
+      slot_ = t_end / cfg.budget;
+    }
+  }
 
   template <typename State>
   void operator()(State const& x, double t) {
-    if (switch_ && t >= t_out_) {
-      f_out_ << t << ' ' << x << "\r\n";
-      t_out_ += dt_;
+    if (policy_ == Output_policy::extrema) {
+      if (switch_) observe(x, t, [](double, State&) {}, false);
+    } else if (switch_ && t >= t_out_) {
+      write(x, t);
+      advance();
     }
   }
 
+  /*
+   * Dense output: every output time up to t is written, with the state taken from the interpolant of the last
+   * step, interp(t_out, x). The samples sit exactly on the out_dt grid whatever the step size is. The extrema are
+   * looked for on the interpolant instead.
+   */
+  template <typename State, typename Interp>
+  void operator()(State& x, double t, Interp&& interp) {
+    if (policy_ == Output_policy::extrema) {
+      if (switch_) {
+        interp(t, x);
+        observe(x, t, interp, true);
+      }
+      return;
+    }
+    for (; switch_ && t_out_ <= t; advance()) {
+      interp(t_out_, x);
+      write(x, t_out_);
+    }
+  }
+
+  /* true if the extrema of e_in are written, which a closed-form solution hands over through extremum() */
+  bool extrema() const { return switch_ && policy_ == Output_policy::extrema; }
+
+  /* an extremum of e_in at time t, a maximum if peak */
+  template <typename State>
+  void extremum(State const& x, double t, bool peak) {
+    emit(Point{t, norm(x.e1()), std::vector<double>(x.begin(), x.end())}, peak);
+  }
+
+  /* the end of the budget slot t falls into; t without a budget */
+  double slot_end(double t) const { return slot_ > 0 ? (floor(t / slot_) + 1) * slot_ : t; }
+
+  /* writes what is held back for the budget; at the end of a task */
+  void flush() {
+    if (!held_) return;
+    write(pending_.x, pending_.t);
+    last_written_ = pending_.t;
+    held_ = false;
+  }
+
+  /* the next output time, or with extrema the time of the last point written */
+  double next_time() const { return policy_ == Output_policy::extrema ? last_written_ : t_out_; }
+
+  /* continue a trajectory whose next output was due at t_out, see next_time() */
+  void resume(double t_out) {
+    t_out_ = t_out;
+    last_written_ = t_out;
+    started_ = true;
+  }
+
  private:
+  struct Point {
+    double t{0};
+    double e{0};
+    std::vector<double> x;
+
+    template <typename State>
+    void set(State const& state, double time, double e_in) {
+      t = time, e = e_in;
+      x.assign(state.begin(), state.end());
+    }
+  };
+
+  enum class Trend { unknown, rising, falling };
+
+  template <typename State>
+  void write(State const& x, double t) {
+    if (type_ == Output_type::binary) {
+      f_out_.write(reinterpret_cast<char const*>(&t), sizeof(double));
+      f_out_.write(reinterpret_cast<char const*>(x.data()), sizeof(double) * x.size());
+    } else {
+      f_out_ << t << ' ';
+      for (auto a : x) {
+        f_out_ << a << ' ';
+      }
+      f_out_ << "\r\n";
+    }
+  }
+
+  void advance() {
+    if (policy_ == Output_policy::log) {
+      t_out_ = t_out_ > 0 ? t_out_ * ratio_ : dt_;
+    } else {
+      t_out_ += dt_;
+    }
+  }
+
+  /*
+   * The extremum finder. The running maximum (hi_) or minimum (lo_) since the last extremum is the next extremum
+   * once e_in has turned away from it by tol_. When it sits at the end of the step before the current one, the
+   * vertex of the parabola through the last three step ends is tried on the interpolant of the current step.
+   */
+  template <typename State, typename Interp>
+  void observe(State const& x, double t, Interp&& interp, bool refinable) {
+    double const e = norm(x.e1());
+
+    if (!started_) {
+      write(x, t);
+      started_ = true;
+    }
+
+    if (steps_ == 0) {
+      hi_.set(x, t, e), lo_.set(x, t, e);
+    } else {
+      auto track = [&](Point& best, double sign) {
+        if (sign * (e - best.e) > 0) {
+          best.set(x, t, e);
+        } else if (refinable && steps_ >= 2 && best.t == t_prev_) {
+          double const d0 = (t_prev_ - t_prev2_) * (e_prev_ - e), d2 = (t_prev_ - t) * (e_prev_ - e_prev2_);
+          if (d0 == d2) return;
+          double const t_vertex =
+              t_prev_ - 0.5 * ((t_prev_ - t_prev2_) * d0 - (t_prev_ - t) * d2) / (d0 - d2);
+          if (t_vertex <= t_prev_ || t_vertex >= t) return;
+          State y;
+          interp(t_vertex, y);
+          double const e_vertex = norm(y.e1());
+          if (sign * (e_vertex - best.e) > 0) {
+            best.set(y, t_vertex, e_vertex);
+          }
+        }
+      };
+
+      if (trend_ != Trend::falling) track(hi_, 1);
+      if (trend_ != Trend::rising) track(lo_, -1);
+
+      if (trend_ == Trend::rising && e < hi_.e - tol_) {
+        emit(hi_, true);
+        lo_.set(x, t, e);
+        trend_ = Trend::falling;
+      } else if (trend_ == Trend::falling && e > lo_.e + tol_) {
+        emit(lo_, false);
+        hi_.set(x, t, e);
+        trend_ = Trend::rising;
+      } else if (trend_ == Trend::unknown && e >= lo_.e + tol_) {
+        trend_ = Trend::rising;
+      } else if (trend_ == Trend::unknown && e <= hi_.e - tol_) {
+        trend_ = Trend::falling;
+      }
+    }
+    t_prev2_ = t_prev_, e_prev2_ = e_prev_;
+    t_prev_ = t, e_prev_ = e;
+    steps_++;
+  }
+
+  void emit(Point const& p, bool peak) {
+    if (slot_ <= 0) {
+      write(p.x, p.t);
+      last_written_ = p.t;
+      return;
+    }
+
+    if (!peak || (last_written_ >= 0 && floor(p.t / slot_) == floor(last_written_ / slot_))) return;
+
+    if (held_ && floor(p.t / slot_) == floor(pending_.t / slot_)) {
+      if (p.e > pending_.e) pending_ = p;
+      return;
+    }
+
+    flush();
+    pending_ = p;
+    held_ = true;
+  }
+
   double const dt_;
   double t_out_;
   std::ostream& f_out_;
   const bool switch_;
+  Output_type const type_;
+  Output_policy const policy_;
+  double const tol_;
+  double ratio_{1};
+  double slot_{0};
+  bool started_{false};
+  size_t steps_{0};
+  Trend trend_{Trend::unknown};
+  Point hi_;
+  Point lo_;
+  Point pending_;
+  bool held_{false};
+  double last_written_{-1};
+  double t_prev_{0};
+  double e_prev_{0};
+  double t_prev2_{0};
+  double e_prev2_{0};
 };
 
 struct SMA_Determinator {
@@ -42,6 +345,50 @@ struct SMA_Determinator {
   double const a_coef_;
   bool const detect_;
 };
+
+/*
+ * The extremes of the inner orbit over the states of one task added so far, usually the ends of its accepted steps,
+ * and its flips, the sign changes of cos(i_mutual) between two of them. In SA the outer orbit is r x v.
+ */
+class Orbit_summary {
+ public:
+  Orbit_summary() = default;
+
+  Orbit_summary(double a_in_coef, bool SA) : a_in_coef_{a_in_coef}, SA_{SA} {}
+
+  /* e_peak is the largest e_in on the way to x when the task was carried there in closed form, without steps */
+  template <typename State>
+  void add(State const& x, double e_peak = 0) {
+    Orbit_shape const in{a_in_coef_, x.L1(), x.e1()};
+
+    double const e = std::max(sqrt(in.e_sqr), e_peak);
+
+    e_max = std::max(e_max, e);
+    a_min = std::min(a_min, in.a);
+    r_p_min = std::min(r_p_min, in.a * (1 - e));
+
+    Vec3 const L_out = SA_ ? cross(x.r(), x.v()) : x.L2();
+
+    double const c = dot(x.L1(), L_out) / (in.L_norm * norm(L_out));
+
+    if (states > 0 && (c < 0) != (cos_i < 0)) {
+      flips++;
+    }
+    cos_i = c;
+    states++;
+  }
+
+  double e_max{0};
+  double a_min{std::numeric_limits<double>::max()};
+  double r_p_min{std::numeric_limits<double>::max()};
+  double cos_i{1};
+  size_t flips{0};
+  size_t states{0};
+
+ private:
+  double a_in_coef_{0};
+  bool SA_{false};
+};
 }  // namespace secular
 
 #endif
@@ -0,0 +1,63 @@
+#ifndef SECULAR_ORBIT_CONTEXT_H
+#define SECULAR_ORBIT_CONTEXT_H
+
+#include <cmath>
+
+#include "tools.h"
+
+namespace secular {
+
+/* the quantities calc_orbit_args derives from one (L, e) pair, and |L|^2 */
+struct Orbit_shape {
+  Orbit_shape() = default;
+
+  Orbit_shape(double Coef, Vec3 const &L_vec, Vec3 const &e_vec)
+      : coef{Coef}, e_sqr{norm2(e_vec)}, L_sqr{norm2(L_vec)} {
+    j_sqr = fabs(1 - e_sqr);
+    j = sqrt(j_sqr);
+    L_norm = sqrt(L_sqr);
+    L = L_norm / j;
+    a = Coef * L * L;
+  }
+
+  /* a sqrt(1 - e^2), as calc_a_eff has it */
+  double a_eff() const { return coef * L_sqr / j; }
+
+  double coef{0};
+  double e_sqr{0};
+  double L_sqr{0};
+  double j_sqr{0};
+  double j{0};
+  double L_norm{0};
+  double L{0};
+  double a{0};
+};
+
+/*
+ * The orbits of one state, derived once per RHS evaluation and handed to every physics term instead of each term
+ * taking the norms and square roots of L and e again. 'in' is always set; 'out' only in DA, where the outer orbit
+ * is a (L2, e2) pair, and r_sqr and r only in SA, where it is the outer position. Quantities only some terms use
+ * (a_eff) are left to accessors of the shape.
+ */
+struct Orbit_context {
+  Orbit_context() = default;
+
+  template <typename Args, typename Container>
+  Orbit_context(Args const &args, Container const &var, bool double_averaged)
+      : in{args.a_in_coef(), var.L1(), var.e1()} {
+    if (double_averaged) {
+      out = Orbit_shape{args.a_out_coef(), var.L2(), var.e2()};
+    } else {
+      r_sqr = norm2(var.r());
+      r = sqrt(r_sqr);
+    }
+  }
+
+  Orbit_shape in;
+  Orbit_shape out;
+  double r_sqr{0};
+  double r{0};
+};
+
+}  // namespace secular
+#endif
@@ -0,0 +1,240 @@
+#ifndef SECULAR_POPULATION_H
+#define SECULAR_POPULATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "rng.h"
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * The law of one sampled quantity, 'population_<name> =': a plain number for a fixed value, or '<law>:<low>:<high>'
+ * without blanks, with law
+ *   uniform      uniform in [low, high);
+ *   log_uniform  uniform in log between low and high (Opik's law, for the semi-major axes);
+ *   thermal      f(x) ~ x in [low, high), the thermal eccentricity distribution, 'thermal' alone for [0, 1);
+ *   isotropic    an angle in deg with its cosine uniform between those of low and high, 'isotropic' alone for [0, 180].
+ */
+enum class Distribution_law { fixed, uniform, log_uniform, thermal, isotropic };
+
+struct Distribution {
+  Distribution_law law{Distribution_law::fixed};
+  double low{0};
+  double high{0};
+
+  template <typename Rng>
+  double operator()(Rng &rng) const {
+    switch (law) {
+      case Distribution_law::uniform:
+        return rng.uniform(low, high);
+      case Distribution_law::log_uniform:
+        return exp(rng.uniform(log(low), log(high)));
+      case Distribution_law::thermal:
+        return sqrt(rng.uniform(low * low, high * high));
+      case Distribution_law::isotropic: {
+        constexpr double rad = consts::pi / 180.0;
+        return acos(rng.uniform(cos(high * rad), cos(low * rad))) / rad;
+      }
+      default:
+        return low;
+    }
+  }
+};
+
+Distribution str_to_distribution(std::string const &key) {
+  std::vector<std::string> parts;
+  for (size_t begin = 0;;) {
+    size_t const end = key.find(':', begin);
+    parts.emplace_back(key.substr(begin, end - begin));
+    if (end == std::string::npos) break;
+    begin = end + 1;
+  }
+
+  auto to_double = [](std::string const &s) {
+    char *last = nullptr;
+    double const x = std::strtod(s.c_str(), &last);
+    if (s.empty() || *last != '\0') throw ReturnFlag::input_err;
+    return x;
+  };
+
+  if (parts.size() == 1 && case_insens_equals(parts[0], "thermal")) {
+    return Distribution{Distribution_law::thermal, 0, 1};
+  } else if (parts.size() == 1 && case_insens_equals(parts[0], "isotropic")) {
+    return Distribution{Distribution_law::isotropic, 0, 180};
+  } else if (parts.size() == 1) {
+    double const x = to_double(parts[0]);
+    return Distribution{Distribution_law::fixed, x, x};
+  } else if (parts.size() != 3) {
+    throw ReturnFlag::input_err;
+  }
+
+  Distribution dist;
+
+  if (case_insens_equals(parts[0], "uniform")) {
+    dist.law = Distribution_law::uniform;
+  } else if (case_insens_equals(parts[0], "log_uniform")) {
+    dist.law = Distribution_law::log_uniform;
+  } else if (case_insens_equals(parts[0], "thermal")) {
+    dist.law = Distribution_law::thermal;
+  } else if (case_insens_equals(parts[0], "isotropic")) {
+    dist.law = Distribution_law::isotropic;
+  } else {
+    throw ReturnFlag::input_err;
+  }
+
+  dist.low = to_double(parts[1]);
+  dist.high = to_double(parts[2]);
+
+  if (dist.low > dist.high || (dist.law == Distribution_law::log_uniform && dist.low <= 0) ||
+      (dist.law == Distribution_law::thermal && dist.low < 0) ||
+      (dist.law == Distribution_law::isotropic && (dist.low < 0 || dist.high > 180))) {
+    throw ReturnFlag::input_err;
+  }
+  return dist;
+}
+
+/*
+ * In-process generator of the initial conditions. With 'population = N' a run samples the tasks population_first,
+ * ..., population_first + N - 1 instead of reading 'input ='. Every task draws its row from its own Counter_rng
+ * stream (population_seed, task_id), so a task gets the same row in every run, with any number of threads and on
+ * any shard; the shards of one population differ only in population_first.
+ *   population_seed                       seed of the streams (default 1);
+ *   population_first                      id of the first task (default 1);
+ *   population_t_end, population_out_dt   the t_end and dt_output columns in yr (out_dt defaults to 0, no output);
+ *   population_m1, population_m2, population_m3   masses in m_solar;
+ *   population_a_in, population_a_out     semi-major axes in au;
+ *   population_e_in, population_e_out     eccentricities (default thermal);
+ *   population_i                          mutual inclination in deg (default isotropic);
+ *   population_stability                  'MA01' to keep the triples that satisfy the criterion of Mardling &
+ *                                         Aarseth (2001), 'off' to keep every draw (default MA01).
+ * omega_in, omega_out, Omega and the mean anomaly are uniform in [0, 360); the mutual inclination is split between
+ * i_in and i_out so that the total angular momentum is along z, and the spins are zero. A draw that misses a cut is
+ * drawn again from the same stream, up to max_draws times.
+ */
+class Population {
+ public:
+  static constexpr size_t max_draws = 10000;
+
+  Population() = default;
+
+  template <typename Config>
+  explicit Population(Config &cfg) {
+    size_ = get_optional<size_t>(cfg, "population", 0);
+
+    if (size_ == 0) return;
+
+    seed_ = get_optional<uint64_t>(cfg, "population_seed", 1);
+
+    first_ = get_optional<size_t>(cfg, "population_first", 1);
+
+    t_end_ = cfg.template get<double>("population_t_end");
+
+    out_dt_ = get_optional<double>(cfg, "population_out_dt", 0.0);
+
+    m1_ = str_to_distribution(cfg.template get<std::string>("population_m1"));
+
+    m2_ = str_to_distribution(cfg.template get<std::string>("population_m2"));
+
+    m3_ = str_to_distribution(cfg.template get<std::string>("population_m3"));
+
+    a_in_ = str_to_distribution(cfg.template get<std::string>("population_a_in"));
+
+    a_out_ = str_to_distribution(cfg.template get<std::string>("population_a_out"));
+
+    e_in_ = str_to_distribution(get_optional<std::string>(cfg, "population_e_in", "thermal"));
+
+    e_out_ = str_to_distribution(get_optional<std::string>(cfg, "population_e_out", "thermal"));
+
+    i_ = str_to_distribution(get_optional<std::string>(cfg, "population_i", "isotropic"));
+
+    std::string const stability = get_optional<std::string>(cfg, "population_stability", "MA01");
+
+    if (case_insens_equals(stability, "MA01")) {
+      stability_cut_ = true;
+    } else if (case_insens_equals(stability, "off")) {
+      stability_cut_ = false;
+    } else {
+      throw ReturnFlag::input_err;
+    }
+
+    if (t_end_ < 0 || out_dt_ < 0 || m1_.low <= 0 || m2_.low <= 0 || m3_.low <= 0 || a_in_.low <= 0 ||
+        a_out_.low <= 0 || e_in_.low < 0 || e_in_.high > 1 || e_out_.low < 0 || e_out_.high > 1 || i_.low < 0 ||
+        i_.high > 180) {
+      throw ReturnFlag::input_err;
+    }
+  }
+
+  /* number of tasks, 0 when the run reads its input instead */
+  size_t size() const { return size_; }
+
+  size_t first() const { return first_; }
+
+  /*
+   * Writes the input row of task_id (the layout of input_columns()) to row[0, 25). Throws input_err if no draw in
+   * max_draws passes the cuts, which only a population whose ranges rule the cuts out should see.
+   */
+  void sample(size_t task_id, double *row) const {
+    Counter_rng rng{seed_, task_id};
+
+    for (size_t draw = 0; draw < max_draws; ++draw) {
+      double const m1 = m1_(rng), m2 = m2_(rng), m3 = m3_(rng);
+      double const a_in = a_in_(rng), a_out = a_out_(rng);
+      double const e_in = e_in_(rng), e_out = e_out_(rng);
+      double const i_mut = i_(rng);
+      double const omega_in = rng.uniform(0, 360), omega_out = rng.uniform(0, 360);
+      double const Omega = rng.uniform(0, 360), M = rng.uniform(0, 360);
+
+      if (e_in >= 1 || e_out >= 1 || a_out <= a_in) continue;
+
+      if (stability_cut_ && !MA01_stable(m1 + m2, m3, a_in, a_out, e_out, i_mut)) continue;
+
+      // the invariable plane: L_in sin(i_in) = L_out sin(i_out) with i_in + i_out = i_mut
+      double const L_in = calc_angular_mom(m1, m2, a_in) * sqrt(1 - e_in * e_in);
+      double const L_out = calc_angular_mom(m1 + m2, m3, a_out) * sqrt(1 - e_out * e_out);
+
+      constexpr double rad = consts::pi / 180.0;
+      double const i_out = atan2(L_in * sin(i_mut * rad), L_out + L_in * cos(i_mut * rad)) / rad;
+
+      double const values[] = {static_cast<double>(task_id), t_end_, out_dt_, m1, m2, m3, a_in, a_out, e_in, e_out,
+                               omega_in, omega_out, Omega, i_mut - i_out, i_out, M};
+
+      std::fill_n(std::copy(std::begin(values), std::end(values), row), 9, 0.0);
+      return;
+    }
+    throw ReturnFlag::input_err;
+  }
+
+ private:
+  size_t size_{0};
+  size_t first_{1};
+  uint64_t seed_{1};
+  double t_end_{0};
+  double out_dt_{0};
+  Distribution m1_;
+  Distribution m2_;
+  Distribution m3_;
+  Distribution a_in_;
+  Distribution a_out_;
+  Distribution e_in_;
+  Distribution e_out_;
+  Distribution i_;
+  bool stability_cut_{true};
+
+  /* Mardling & Aarseth (2001), eq. 90, with their inclination factor */
+  static bool MA01_stable(double m_in, double m_out, double a_in, double a_out, double e_out, double i_mut) {
+    double const q_out = m_out / m_in;
+    double const ratio =
+        2.8 * pow((1 + q_out) * (1 + e_out) / sqrt(1 - e_out), 0.4) / (1 - e_out) * (1 - 0.3 * i_mut / 180);
+    return a_out / a_in > ratio;
+  }
+};
+
+}  // namespace secular
+#endif
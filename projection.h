@@ -0,0 +1,109 @@
+#ifndef SECULAR_PROJECTION_H
+#define SECULAR_PROJECTION_H
+
+#include <algorithm>
+#include <cmath>
+
+#include "secular.h"
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * Projection of the state back onto the orbits after an accepted step ('projection = on'). The integrator lets
+ * the Laplace-Runge-Lenz vector drift out of the orbital plane, which nothing in the RHS corrects and which at
+ * loose tolerances ends in |e| >= 1 or a wrong semimajor axis. Each e is rotated into the plane normal to its L,
+ * keeping |e|, so the semimajor axis read off |L| and |e| does not move; in DA the outer semimajor axis, a
+ * constant of the double-averaged motion, is restored by rescaling |L2|. The SA outer orbit is carried as
+ * position and velocity and is left alone.
+ *
+ * The correction is the largest of |e.n| over the pairs and the relative change of |L2|. A state is only projected
+ * once it exceeds projection_tol: the stepper has to restart from the projected state, which costs the dense
+ * Bulirsch-Stoer stepper its order history, so projecting the roundoff-sized drift of every step would do more
+ * harm than good.
+ */
+class Orbit_projector {
+ public:
+  explicit Orbit_projector(SecularConst const &args) : a_out_coef_{args.a_out_coef()} {}
+
+  /* forget the outer semimajor axis, for a state that was converted between SA and DA */
+  void reset() { a_out_ = 0; }
+
+  /* project x if it is further than tol off the orbits; returns the correction, 0 if x was left as it is */
+  template <typename Container>
+  double operator()(Container &x, LK_method method, double tol) {
+    bool const DA = method == LK_method::DA;
+
+    double const L2_norm = norm(x.L2x(), x.L2y(), x.L2z());
+
+    double const e2_sqr = norm2(x.e2x(), x.e2y(), x.e2z());
+
+    // the outer semimajor axis is taken from the first state seen, |L2| is rescaled to it
+    double scale = 1;
+
+    if (DA && L2_norm > 0 && e2_sqr < 1) {
+      double const j2 = sqrt(1 - e2_sqr);
+      if (a_out_ == 0) {
+        a_out_ = a_out_coef_ * L2_norm * L2_norm / (j2 * j2);
+      }
+      scale = j2 * sqrt(a_out_ / a_out_coef_) / L2_norm;
+    }
+
+    double const correction =
+        std::max({off_plane(x.L1x(), x.L1y(), x.L1z(), x.e1x(), x.e1y(), x.e1z()),
+                  DA ? off_plane(x.L2x(), x.L2y(), x.L2z(), x.e2x(), x.e2y(), x.e2z()) : 0.0, fabs(scale - 1)});
+
+    if (correction <= tol) return 0;
+
+    double ex = x.e1x(), ey = x.e1y(), ez = x.e1z();
+
+    orthogonalize(x.L1x(), x.L1y(), x.L1z(), ex, ey, ez);
+
+    x.set_e1(ex, ey, ez);
+
+    if (DA) {
+      ex = x.e2x(), ey = x.e2y(), ez = x.e2z();
+
+      orthogonalize(x.L2x(), x.L2y(), x.L2z(), ex, ey, ez);
+
+      x.set_e2(ex, ey, ez);
+
+      x.set_L2(scale * x.L2x(), scale * x.L2y(), scale * x.L2z());
+    }
+    return correction;
+  }
+
+ private:
+  double a_out_coef_;
+  double a_out_{0};
+
+  /* |e.n|, the component of e along L */
+  static double off_plane(double lx, double ly, double lz, double ex, double ey, double ez) {
+    double const L = norm(lx, ly, lz);
+    return L > 0 ? fabs(dot(ex, ey, ez, lx, ly, lz)) / L : 0;
+  }
+
+  /* rotate e into the plane normal to L, keeping |e| */
+  static void orthogonalize(double lx, double ly, double lz, double &ex, double &ey, double &ez) {
+    double const L = norm(lx, ly, lz);
+
+    if (L == 0) return;
+
+    double const nx = lx / L, ny = ly / L, nz = lz / L;
+
+    double const en = dot(ex, ey, ez, nx, ny, nz);
+
+    double const e = norm(ex, ey, ez);
+
+    double const px = ex - en * nx, py = ey - en * ny, pz = ez - en * nz;
+
+    double const p = norm(px, py, pz);
+
+    if (p == 0) return;
+
+    ex = px * e / p, ey = py * e / p, ez = pz * e / p;
+  }
+};
+
+}  // namespace secular
+#endif
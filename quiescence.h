@@ -0,0 +1,163 @@
+#ifndef SECULAR_QUIESCENCE_H
+#define SECULAR_QUIESCENCE_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include "LK.h"
+#include "orbit_context.h"
+#include "secular.h"
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * 'quiescence = on' stops a task once its inner orbit has settled into steady oscillations, as it does below the
+ * LK window or when GR precession quenches the cycles. Only a task whose physics has a closed form (quadrupole-only
+ * DA, where 'analytic' allows it) is then carried on to t_end; any other ends early, at the time it was stopped, with
+ * the flag quiescent and the state of that time in last_state.txt, and the ensemble leaves it out of its quantities.
+ * The keys:
+ *   quiescence_periods  how many LK times (see Quiescence_detector) a task runs at least before it is stopped (10);
+ *   quiescence_tol      the largest change of the e_in and cos(i_mutual) envelopes, and of a_in / a_in_init, for
+ *                       which the two halves of the run still count as the same motion (1e-3);
+ *   quiescence_checks   how many checks in a row have to find the same motion (3), which guards against slow
+ *                       modulations that a single pair of halves can miss.
+ */
+struct Quiescence_config {
+  Quiescence_config() = default;
+
+  template <typename Config>
+  explicit Quiescence_config(Config &cfg) {
+    on = str_to_bool(get_optional<std::string>(cfg, "quiescence", "off"));
+
+    periods = get_optional<double>(cfg, "quiescence_periods", 10.0);
+
+    tol = get_optional<double>(cfg, "quiescence_tol", 1e-3);
+
+    checks = get_optional<size_t>(cfg, "quiescence_checks", 3);
+
+    if (periods <= 0 || tol <= 0 || checks == 0) {
+      throw ReturnFlag::input_err;
+    }
+  }
+
+  bool on{false};
+  double periods{10};
+  double tol{1e-3};
+  size_t checks{3};
+};
+
+/*
+ * Watches the accepted steps of one task for quiescence. The run from its start t0 is split at t0 + P / 2, and
+ * the envelopes of e_in, cos(i_mutual) and a_in / a_in_init in the two halves are compared at t0 + P. P is
+ * quiescence_periods t_k_quad, or with the octupole on quiescence_periods octupole times t_k_quad / sqrt(eps_oct)
+ * (Antognini 2015), the scale on which it modulates the LK cycles. Bounded periodic motion fills both halves alike
+ * once they span a cycle; a secular drift, LK cycles that are still growing or a decaying a_in does not. After each
+ * check the whole run becomes the first half of one twice as long, so the checks cost nothing per step but a few
+ * comparisons; the task stops once quiescence_checks of them in a row found the halves alike.
+ */
+class Quiescence_detector {
+ public:
+  /* iter points to m1 of the input row, as for initialize_orbit_args; t0 is the time the task (re)starts at */
+  template <typename Iter>
+  Quiescence_detector(Quiescence_config const &cfg, Controller const &ctrl, SecularConst const &args, Iter iter,
+                      double t0)
+      : on_{cfg.on},
+        tol_{cfg.tol},
+        checks_{cfg.checks},
+        a_in_coef_{args.a_in_coef()},
+        SA_{ctrl.ave_method == LK_method::SA},
+        t0_{t0} {
+    auto const [m1, m2, m3, a_in, a_out, e_in, e_out] = unpack_args<7>(iter);
+
+    a_in_init_ = a_in;
+
+    double const j2_sqr = fabs(1 - e_out * e_out);
+
+    double span = cfg.periods * t_k_quad(m1 + m2, m3, a_in, a_out * sqrt(j2_sqr));
+
+    double const eps_oct = normed_oct_epsilon(m1, m2, a_in, a_out) * e_out / j2_sqr;
+
+    if (ctrl.Oct && eps_oct > 0) {
+      span /= sqrt(eps_oct);
+    }
+    half_ = t0 + 0.5 * span;
+    check_ = t0 + span;
+  }
+
+  bool on() const { return on_; }
+
+  /* true once the state x at time t, the end of an accepted step, completes a quiescent run */
+  template <typename State>
+  bool operator()(State const &x, double t) {
+    if (!on_) return false;
+
+    Orbit_shape const in{a_in_coef_, x.L1(), x.e1()};
+
+    Vec3 const L_out = SA_ ? cross(x.r(), x.v()) : x.L2();
+
+    double const cos_i = dot(x.L1(), L_out) / (in.L_norm * norm(L_out));
+
+    (t < half_ ? older_ : recent_).add(sqrt(in.e_sqr), cos_i, in.a / a_in_init_);
+
+    if (t < check_) return false;
+
+    passed_ = older_.matches(recent_, tol_) ? passed_ + 1 : 0;
+
+    if (passed_ == checks_) return true;
+
+    older_.merge(recent_);
+    recent_ = Envelope{};
+    half_ = check_;
+    check_ = t0_ + 2 * (check_ - t0_);
+    return false;
+  }
+
+ private:
+  struct Envelope {
+    double e_min{std::numeric_limits<double>::max()};
+    double e_max{-std::numeric_limits<double>::max()};
+    double cos_min{std::numeric_limits<double>::max()};
+    double cos_max{-std::numeric_limits<double>::max()};
+    double a_min{std::numeric_limits<double>::max()};
+    double a_max{-std::numeric_limits<double>::max()};
+
+    void add(double e, double cos_i, double a) {
+      e_min = std::min(e_min, e), e_max = std::max(e_max, e);
+      cos_min = std::min(cos_min, cos_i), cos_max = std::max(cos_max, cos_i);
+      a_min = std::min(a_min, a), a_max = std::max(a_max, a);
+    }
+
+    void merge(Envelope const &other) {
+      add(other.e_min, other.cos_min, other.a_min);
+      add(other.e_max, other.cos_max, other.a_max);
+    }
+
+    bool empty() const { return e_min > e_max; }
+
+    bool matches(Envelope const &other, double tol) const {
+      if (empty() || other.empty()) return false;
+      return fabs(e_min - other.e_min) < tol && fabs(e_max - other.e_max) < tol &&
+             fabs(cos_min - other.cos_min) < tol && fabs(cos_max - other.cos_max) < tol &&
+             std::max(a_max, other.a_max) - std::min(a_min, other.a_min) < tol;
+    }
+  };
+
+  bool on_;
+  double tol_;
+  size_t checks_;
+  size_t passed_{0};
+  double a_in_coef_;
+  double a_in_init_;
+  bool SA_;
+  double t0_;
+  double half_;
+  double check_;
+  Envelope older_;
+  Envelope recent_;
+};
+
+}  // namespace secular
+#endif
@@ -0,0 +1,400 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Regression run over reg_test/: every cfg/std_<i>.cfg.txt is run by the secular executable on row i of
+ * InitialParameters.csv, over the time span of the reference curve std/eccentricity_<i>.txt. The run keeps the
+ * stepper and output mode of its config, so the RHS evaluations and wall time of the task (from stats.txt) are those
+ * of the path production runs take. Its outputs fall on step ends, between which the reference spacing is too coarse
+ * to interpolate an LK cycle, so unless the config has dense output anyway a second run with dense_output = on
+ * writes e(t) on the reference spacing; that is interpolated onto the reference times and the max and RMS deviation
+ * are reported. A reference that does not start from the e_in of its row belongs to another setup and is skipped.
+ *
+ * The references are not exact solutions of the configs, so a case fails against a recorded baseline instead:
+ * when its max deviation grows by more than acc_tol, its RHS count by more than rhs_tol or its wall time by more
+ * than time_tol (relative), and when it has no baseline at all. The wall time is kept relative to that of case
+ * time_ref, which is run first in the same invocation, so that the check holds on any machine. Two more baseline
+ * columns set a case up rather than record it: acc_until, the last reference time the deviation is taken up to,
+ * and rhs_tol, the RHS tolerance of the case. Case 11 has both: its chaotic orbit parts from the reference after
+ * the first LK cycles and changes its steps with the floating-point contraction of the build.
+ *
+ * 'record' writes the measured columns of the baseline from the current run. A '-' in the baseline leaves its
+ * column unchecked (the whole span, the global rhs_tol for the setup columns) and stays on record; 'overwrite'
+ * replaces it too. The runs go to reg_test/run/.
+ *
+ * usage: regression [record [overwrite]] [secular=./secular] [dir=reg_test] [cases=1,2,...] [time_ref=1]
+ *                   [acc_tol=1e-3] [rhs_tol=0.05] [time_tol=0.5]
+ */
+
+namespace fs = std::filesystem;
+
+using Table = std::vector<std::vector<double>>;
+
+constexpr size_t case_num = 14;
+
+// case, max_dev, rms_dev, rhs_calls, wall time relative to the time_ref case; acc_until and rhs_tol
+constexpr size_t measured_cols = 5;
+constexpr size_t baseline_cols = 7;
+
+// wall time differences below this are timer and scheduling noise on the short cases
+constexpr double min_time_change = 0.05;
+
+struct Result {
+  size_t compared{0};
+  size_t expected{0};
+  double max_dev{0};
+  double rms_dev{0};
+  double rhs_calls{0};
+  double wall_time{0};
+  bool ran{false};
+  bool skipped{false};
+};
+
+Table load_table(std::string const &path) {
+  Table table;
+  std::ifstream file{path};
+  for (std::string line; std::getline(file, line);) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream is{line};
+    std::vector<double> row;
+    for (double x; is >> x;) {
+      row.emplace_back(x);
+    }
+    if (!row.empty()) table.emplace_back(std::move(row));
+  }
+  return table;
+}
+
+/* the rows of baseline.txt, with NaN for the columns left unchecked */
+std::map<size_t, std::vector<double>> load_baseline(std::string const &path) {
+  std::map<size_t, std::vector<double>> baseline;
+  std::ifstream file{path};
+  for (std::string line; std::getline(file, line);) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream is{line};
+    size_t id;
+    if (!(is >> id)) continue;
+    std::vector<double> row{static_cast<double>(id)};
+    for (std::string c; is >> c;) {
+      row.emplace_back(c == "-" ? std::nan("") : std::stod(c));
+    }
+    row.resize(baseline_cols, std::nan(""));
+    baseline[id] = std::move(row);
+  }
+  return baseline;
+}
+
+std::vector<std::string> load_lines(std::string const &path) {
+  std::vector<std::string> lines;
+  std::ifstream file{path};
+  for (std::string line; std::getline(file, line);) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    lines.emplace_back(line);
+  }
+  return lines;
+}
+
+bool starts_with(std::string const &line, std::string const &key) {
+  return line.compare(0, key.size(), key) == 0 && line.find('=') != std::string::npos;
+}
+
+/* true if the config switches dense output on itself */
+bool dense_config(std::string const &src) {
+  bool dense = false;
+  for (auto const &line : load_lines(src)) {
+    if (!starts_with(line, "dense_output")) continue;
+    std::string value = line.substr(line.find('=') + 1);
+    value.erase(std::remove_if(value.begin(), value.end(), [](unsigned char c) { return std::isspace(c); }),
+                value.end());
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+    dense = value == "on" || value == "true" || value == "1";
+  }
+  return dense;
+}
+
+/* the std config with its input and output redirected to the scratch directory of the case, dense output forced on
+ * for the accuracy run */
+void write_config(std::string const &src, std::string const &dst, std::string const &input,
+                  std::string const &output_dir, bool dense) {
+  std::ofstream cfg{dst};
+  for (auto const &line : load_lines(src)) {
+    if (starts_with(line, "output_dir")) {
+      cfg << "output_dir = " << output_dir << '\n';
+    } else if (starts_with(line, "input")) {
+      cfg << "input = " << input << '\n';
+    } else if (!dense || !starts_with(line, "dense_output")) {
+      cfg << line << '\n';
+    }
+  }
+  if (dense) cfg << "dense_output = on\n";
+}
+
+std::vector<std::string> split(std::string const &row) {
+  std::istringstream is{row};
+  std::vector<std::string> cols;
+  for (std::string c; is >> c;) {
+    cols.emplace_back(c);
+  }
+  return cols;
+}
+
+/* the input row with t_end at the last reference time and out_dt on the reference spacing */
+void write_input(std::string const &row, std::string const &dst, Table const &reference) {
+  auto cols = split(row);
+
+  double const spacing = reference.size() > 1 ? reference[1][0] - reference[0][0] : reference.back()[0];
+
+  // one output past the last reference time, so that it is bracketed
+  double const t_end = reference.back()[0] + spacing;
+
+  std::ostringstream t_end_str, out_dt_str;
+  t_end_str << std::setprecision(17) << t_end;
+  out_dt_str << std::setprecision(17) << spacing;
+
+  cols[1] = t_end_str.str();
+  cols[2] = out_dt_str.str();
+
+  std::ofstream input{dst};
+  for (auto const &c : cols) {
+    input << c << ' ';
+  }
+  input << '\n';
+}
+
+/* e(t) of the run, linearly interpolated onto the reference times it covers up to t_until */
+void compare(Table const &trajectory, Table const &reference, double t_until, Result &res) {
+  res.expected = std::count_if(reference.begin(), reference.end(), [&](auto const &ref) { return ref[0] <= t_until; });
+
+  if (trajectory.size() < 2) return;
+
+  double sum = 0;
+
+  size_t k = 0;
+
+  for (auto const &ref : reference) {
+    double const t = ref[0];
+
+    if (t > t_until) break;
+
+    if (t < trajectory.front()[0] || t > trajectory.back()[0]) continue;
+
+    for (; k + 2 < trajectory.size() && trajectory[k + 1][0] < t; ++k) {
+    }
+
+    auto const &a = trajectory[k];
+    auto const &b = trajectory[k + 1];
+
+    double const ea = std::sqrt(a[4] * a[4] + a[5] * a[5] + a[6] * a[6]);
+    double const eb = std::sqrt(b[4] * b[4] + b[5] * b[5] + b[6] * b[6]);
+    double const w = b[0] > a[0] ? (t - a[0]) / (b[0] - a[0]) : 0;
+    double const dev = std::fabs(ea + w * (eb - ea) - ref[1]);
+
+    res.max_dev = std::max(res.max_dev, dev);
+    sum += dev * dev;
+    res.compared++;
+  }
+
+  res.rms_dev = res.compared > 0 ? std::sqrt(sum / res.compared) : 0;
+}
+
+Result run_case(size_t i, std::string const &secular, std::string const &dir, std::string const &row,
+                double t_until) {
+  Result res;
+
+  std::string const id = std::to_string(i);
+
+  std::string const case_dir = dir + "/run/case_" + id;
+
+  fs::remove_all(case_dir);
+  fs::create_directories(case_dir);
+
+  Table const reference = load_table(dir + "/std/eccentricity_" + id + ".txt");
+
+  constexpr size_t e_in_col = 8;
+
+  if (reference.empty() || std::fabs(reference[0][1] - std::stod(split(row).at(e_in_col))) > 1e-6) {
+    res.skipped = true;
+    return res;
+  }
+
+  write_input(row, case_dir + "/init.txt", reference);
+
+  std::string const src = dir + "/cfg/std_" + id + ".cfg.txt";
+
+  auto run = [&](std::string const &run_dir, bool dense) {
+    write_config(src, run_dir + "/cfg.txt", case_dir + "/init.txt", run_dir, dense);
+    std::string const cmd = secular + " " + run_dir + "/cfg.txt > " + run_dir + "/stdout.txt 2>&1";
+    return std::system(cmd.c_str()) == 0;
+  };
+
+  res.ran = run(case_dir, false);
+
+  std::string accuracy_dir = case_dir;
+
+  if (!dense_config(src)) {
+    accuracy_dir = case_dir + "/dense";
+    fs::create_directories(accuracy_dir);
+    res.ran = run(accuracy_dir, true) && res.ran;
+  }
+
+  compare(load_table(accuracy_dir + "/secular_" + id + ".txt"), reference, t_until, res);
+
+  std::ifstream stats{case_dir + "/stats.txt"};
+  for (std::string line; std::getline(stats, line);) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream is{line};
+    std::string task, flag;
+    is >> task >> flag >> res.rhs_calls >> res.wall_time;
+  }
+  return res;
+}
+
+int main(int argc, char **argv) {
+  std::ios::sync_with_stdio(false);
+
+  std::map<std::string, std::string> opt{
+      {"secular", "./secular"}, {"dir", "reg_test"}, {"cases", ""},       {"time_ref", "1"},
+      {"acc_tol", "1e-3"},      {"rhs_tol", "0.05"}, {"time_tol", "0.5"}};
+
+  bool record = false;
+  bool overwrite = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string const arg = argv[i];
+    auto const eq = arg.find('=');
+    if (arg == "record") {
+      record = true;
+    } else if (arg == "overwrite") {
+      overwrite = true;
+    } else if (eq != std::string::npos && opt.count(arg.substr(0, eq))) {
+      opt[arg.substr(0, eq)] = arg.substr(eq + 1);
+    } else {
+      std::cout << "unknown argument " << arg << '\n';
+      return 2;
+    }
+  }
+
+  std::string const dir = opt["dir"];
+
+  double const acc_tol = std::stod(opt["acc_tol"]);
+  double const rhs_tol = std::stod(opt["rhs_tol"]);
+  double const time_tol = std::stod(opt["time_tol"]);
+
+  std::vector<size_t> cases;
+  std::istringstream case_list{opt["cases"]};
+  for (std::string c; std::getline(case_list, c, ',');) {
+    cases.emplace_back(std::stoul(c));
+  }
+  if (cases.empty()) {
+    for (size_t i = 1; i <= case_num; ++i) {
+      cases.emplace_back(i);
+    }
+  }
+
+  // the time_ref case goes first, its wall time is the unit of the others
+  size_t const time_ref = std::stoul(opt["time_ref"]);
+  cases.erase(std::remove(cases.begin(), cases.end(), time_ref), cases.end());
+  cases.insert(cases.begin(), time_ref);
+
+  double ref_time = std::nan("");
+
+  std::map<size_t, std::string> rows;
+  for (auto const &line : load_lines(dir + "/InitialParameters.csv")) {
+    std::istringstream is{line};
+    size_t id;
+    if (is >> id) rows[id] = line;
+  }
+
+  auto baseline = load_baseline(dir + "/baseline.txt");
+
+  std::cout << std::left << std::setw(6) << "#case" << std::right << std::setw(12) << "compared" << std::setw(14)
+            << "max|de|" << std::setw(14) << "rms|de|" << std::setw(14) << "rhs_calls" << std::setw(12) << "wall[s]"
+            << std::setw(10) << "/t_ref" << "  status\n";
+
+  size_t failures = 0;
+
+  for (size_t i : cases) {
+    if (!rows.count(i)) continue;
+
+    double const t_until = baseline.count(i) && !std::isnan(baseline[i][5]) ? baseline[i][5] : HUGE_VAL;
+
+    Result const res = run_case(i, opt["secular"], dir, rows[i], t_until);
+
+    if (res.skipped) {
+      std::cout << std::left << std::setw(6) << i << "  skipped, the reference does not start from this row\n";
+      continue;
+    }
+
+    if (i == time_ref && res.ran && res.wall_time > 0) ref_time = res.wall_time;
+
+    double const ratio = res.wall_time / ref_time;
+
+    std::string status = "ok";
+
+    if (!res.ran || res.compared < res.expected) {
+      status = "FAIL(run)";
+    } else if (baseline.count(i)) {
+      auto const &b = baseline[i];
+      // comparisons with an unchecked (NaN) column are false
+      if (res.max_dev > b[1] + acc_tol) {
+        status = "FAIL(accuracy)";
+      } else if (res.rhs_calls > b[3] * (1 + (std::isnan(b[6]) ? rhs_tol : b[6]))) {
+        status = "FAIL(rhs_calls)";
+      } else if (ratio > b[4] * (1 + time_tol) && (ratio - b[4]) * ref_time > min_time_change) {
+        status = "FAIL(time)";
+      }
+    } else if (!record) {
+      status = "FAIL(no baseline)";
+    }
+
+    failures += status.compare(0, 4, "FAIL") == 0;
+
+    std::cout << std::left << std::setw(6) << i << std::right << std::setw(7) << res.compared << '/' << std::setw(4)
+              << std::left << res.expected << std::right << std::scientific << std::setprecision(3)
+              << std::setw(14) << res.max_dev << std::setw(14) << res.rms_dev << std::fixed << std::setprecision(0)
+              << std::setw(14) << res.rhs_calls << std::setprecision(3) << std::setw(12) << res.wall_time
+              << std::setw(10) << ratio << "  " << status << std::endl;
+
+    if (record && res.ran) {
+      bool const fresh = !baseline.count(i);
+      auto &b = baseline[i];
+      if (fresh) b.assign(baseline_cols, std::nan(""));
+      double const measured[measured_cols] = {static_cast<double>(i), res.max_dev, res.rms_dev, res.rhs_calls, ratio};
+      for (size_t k = 0; k < measured_cols; ++k) {
+        if (fresh || overwrite || !std::isnan(b[k])) b[k] = measured[k];
+      }
+    }
+  }
+
+  // cases left out of this run keep their recorded entry
+  if (record) {
+    std::ofstream table{dir + "/baseline.txt"};
+    table << "#case max_dev rms_dev rhs_calls wall_time/time_ref acc_until rhs_tol\n" << std::setprecision(10);
+    for (auto const &[i, b] : baseline) {
+      table << i;
+      for (size_t k = 1; k < b.size(); ++k) {
+        if (std::isnan(b[k])) {
+          table << " -";
+        } else {
+          table << ' ' << b[k];
+        }
+      }
+      table << '\n';
+    }
+    std::cout << "baseline written to " << dir << "/baseline.txt\n";
+  }
+
+  std::cout << failures << " case(s) failed\n";
+
+  return failures == 0 ? 0 : 1;
+}
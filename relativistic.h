@@ -1,6 +1,7 @@
 #ifndef RELATIVISTIC_H
 #define RELATIVISTIC_H
 
+#include "orbit_context.h"
 #include "tools.h"
 
 namespace secular {
@@ -32,34 +33,33 @@ class GRConst {
   double GW_e_coef_{0};
 };
 
-#define GR_PROCESS(ACOEF, COEF, num)                                                                           \
-  {                                                                                                            \
-    double a_eff = calc_a_eff(args.ACOEF, var.L##num##x(), var.L##num##y(), var.L##num##z(), var.e##num##x(),  \
-                              var.e##num##y(), var.e##num##z());                                               \
-    double Omega = args.COEF / (a_eff * a_eff * a_eff);                                                        \
-    dvar.add_e##num(cross_with_coef(Omega, var.L##num##x(), var.L##num##y(), var.L##num##z(), var.e##num##x(), \
-                                    var.e##num##y(), var.e##num##z()));                                        \
+#define GR_PROCESS(ORBIT, COEF, num)                                                     \
+  {                                                                                      \
+    double a_eff = orbits.ORBIT.a_eff();                                                 \
+    double Omega = args.COEF / (a_eff * a_eff * a_eff);                                  \
+    dvar.add_e##num(cross_with_coef(Omega, var.L##num(), var.e##num()));                 \
   }
 
 template <typename Ctrl, typename Args, typename Container>
-inline void GR_precession(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar) {
+inline void GR_precession(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar,
+                          Orbit_context const &orbits) {
   if (ctrl.GR_in == true) {
-    GR_PROCESS(a_in_coef(), GR_in_coef(), 1);
+    GR_PROCESS(in, GR_in_coef(), 1);
   }
 
   if (ctrl.GR_out == true) {
     if (ctrl.ave_method == LK_method::DA) {
-      GR_PROCESS(a_out_coef(), GR_out_coef(), 2);
+      GR_PROCESS(out, GR_out_coef(), 2);
     } else {
     }
   }
 }
 
 template <typename Ctrl, typename Args, typename Container>
-inline void GW_radiation(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar) {
+inline void GW_radiation(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar,
+                         Orbit_context const &orbits) {
   if (ctrl.GW_in == true) {
-    auto [e1_sqr, j1_sqr, j1, L1_norm, L_in, a_in] =
-        calc_orbit_args(args.a_in_coef(), var.L1x(), var.L1y(), var.L1z(), var.e1x(), var.e1y(), var.e1z());
+    double const e1_sqr = orbits.in.e_sqr, j1 = orbits.in.j, a_in = orbits.in.a;
 
     double a_eff = a_in * j1;
 
@@ -71,9 +71,9 @@ inline void GW_radiation(Ctrl const &ctrl, Args const &args, Container const &va
 
     double GW_e_coef = args.GW_e_in_coef() / a_eff4 / j1 * (1 + 121.0 / 304 * e1_sqr);
 
-    dvar.add_L1(GW_L_coef * var.L1x(), GW_L_coef * var.L1y(), GW_L_coef * var.L1z());
+    dvar.add_L1(GW_L_coef * var.L1());
 
-    dvar.add_e1(GW_e_coef * var.e1x(), GW_e_coef * var.e1y(), GW_e_coef * var.e1z());
+    dvar.add_e1(GW_e_coef * var.e1());
   }
 }
 }  // namespace secular
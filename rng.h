@@ -0,0 +1,70 @@
+#ifndef SECULAR_RNG_H
+#define SECULAR_RNG_H
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * Counter-based generator, Philox4x32-10 (Salmon et al. 2011, "Parallel random numbers: as easy as 1, 2, 3").
+ * The n-th output is a keyed hash of n, so a stream owns no state worth sharing: the stream of a task is fixed by
+ * (seed, task_id) alone, whichever thread draws it, in whichever order and on whichever shard of the run.
+ */
+class Counter_rng {
+ public:
+  Counter_rng(uint64_t seed, uint64_t stream)
+      : key_{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)},
+        ctr_{0, 0, static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)} {}
+
+  /* uniform in [0, 1), 53 random bits */
+  double uniform() { return static_cast<double>(next_u64() >> 11) * 0x1.0p-53; }
+
+  double uniform(double low, double high) { return low + (high - low) * uniform(); }
+
+  /* Box-Muller; the second variate of the pair is dropped, so every draw costs the same number of outputs */
+  double normal(double mean, double sigma) {
+    double const u1 = 1 - uniform();
+    double const u2 = uniform();
+    return mean + sigma * sqrt(-2 * log(u1)) * cos(2 * consts::pi * u2);
+  }
+
+ private:
+  std::array<uint32_t, 2> key_;
+  std::array<uint32_t, 4> ctr_;
+  std::array<uint32_t, 4> block_{};
+  size_t used_{4};
+
+  uint64_t next_u64() {
+    if (used_ == 4) {
+      block_ = philox(ctr_, key_);
+      used_ = 0;
+      // the low 64 bits count the blocks, the high 64 bits are the stream
+      if (++ctr_[0] == 0) ++ctr_[1];
+    }
+    uint64_t const x = (static_cast<uint64_t>(block_[used_]) << 32) | block_[used_ + 1];
+    used_ += 2;
+    return x;
+  }
+
+  static std::array<uint32_t, 4> philox(std::array<uint32_t, 4> ctr, std::array<uint32_t, 2> key) {
+    constexpr uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57, W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+    for (int round = 0; round < 10; ++round) {
+      uint64_t const p0 = static_cast<uint64_t>(M0) * ctr[0];
+      uint64_t const p1 = static_cast<uint64_t>(M1) * ctr[2];
+
+      ctr = {static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0], static_cast<uint32_t>(p1),
+             static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1], static_cast<uint32_t>(p0)};
+
+      key[0] += W0, key[1] += W1;
+    }
+    return ctr;
+  }
+};
+
+}  // namespace secular
+#endif
@@ -0,0 +1,36 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "SpaceHub/src/tools/config-reader.hpp"
+#include "input.h"
+#include "population.h"
+
+// the 25 columns of secular::input_columns()
+constexpr size_t PARAMETER_NUM = 25;
+
+int main(int argc, char **argv) {
+  std::ios::sync_with_stdio(false);
+
+  if (argc != 2) {
+    std::cout << "usage: " << argv[0] << " config.txt > input.txt\n";
+    return 0;
+  }
+
+  space::tools::ConfigReader cfg{argv[1]};
+
+  secular::Population const population{cfg};
+
+  double row[PARAMETER_NUM];
+
+  std::cout << '#' << secular::input_columns() << "\r\n" << std::setprecision(17);
+
+  for (size_t task_id = population.first(); task_id < population.first() + population.size(); ++task_id) {
+    population.sample(task_id, row);
+    std::cout << task_id;
+    for (size_t j = 1; j < PARAMETER_NUM; ++j) {
+      std::cout << ' ' << row[j];
+    }
+    std::cout << "\r\n";
+  }
+  return 0;
+}
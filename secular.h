@@ -14,8 +14,17 @@
 
 namespace secular {
 
-class SecularArray : public std::array<double, 21> {
+/*
+ * State vector of the secular evolution. The spin slots are only allocated when the configuration needs them:
+ * 12 for the bare (L1, e1, L2/r, e2/v), 18 with the inner spins and 21 with the outer spin as well.
+ */
+template <size_t SpinNum>
+class SecularArray : public std::array<double, 12 + 3 * SpinNum> {
  public:
+  static constexpr size_t s_num{SpinNum};
+
+  static constexpr size_t dim{12 + 3 * SpinNum};
+
   SecularArray() = default;
 
   READ_GETTER(double, L1x, (*this)[0]);
@@ -54,17 +63,17 @@ class SecularArray : public std::array<double, 21> {
 
   READ_GETTER(double, vz, (*this)[11]);
 
-  // READ_GETTER(auto, L1, std::tie((*this)[0], (*this)[1], (*this)[2]));
+  VEC3_GETTER(L1, (*this)[0], (*this)[1], (*this)[2]);
 
-  // READ_GETTER(auto, e1, std::tie((*this)[3], (*this)[4], (*this)[5]));
+  VEC3_GETTER(e1, (*this)[3], (*this)[4], (*this)[5]);
 
-  // READ_GETTER(auto, L2, std::tie((*this)[6], (*this)[7], (*this)[8]));
+  VEC3_GETTER(L2, (*this)[6], (*this)[7], (*this)[8]);
 
-  // READ_GETTER(auto, e2, std::tie((*this)[9], (*this)[10], (*this)[11]));
+  VEC3_GETTER(e2, (*this)[9], (*this)[10], (*this)[11]);
 
-  // READ_GETTER(auto, r, std::tie((*this)[6], (*this)[7], (*this)[8]));
+  VEC3_GETTER(r, (*this)[6], (*this)[7], (*this)[8]);
 
-  // READ_GETTER(auto, v, std::tie((*this)[9], (*this)[10], (*this)[11]));
+  VEC3_GETTER(v, (*this)[9], (*this)[10], (*this)[11]);
 
   STD_3WAY_SETTER(L1, (*this)[0], (*this)[1], (*this)[2]);
 
@@ -78,29 +87,35 @@ class SecularArray : public std::array<double, 21> {
 
   STD_3WAY_SETTER(v, (*this)[9], (*this)[10], (*this)[11]);
 
-  READ_GETTER(double, S1x, (*this)[12]);
+  OPT_READ_GETTER(SpinNum >= 2, double, S1x, (*this)[12]);
+
+  OPT_READ_GETTER(SpinNum >= 2, double, S1y, (*this)[13]);
 
-  READ_GETTER(double, S1y, (*this)[13]);
+  OPT_READ_GETTER(SpinNum >= 2, double, S1z, (*this)[14]);
 
-  READ_GETTER(double, S1z, (*this)[14]);
+  OPT_READ_GETTER(SpinNum >= 2, double, S2x, (*this)[15]);
 
-  READ_GETTER(double, S2x, (*this)[15]);
+  OPT_READ_GETTER(SpinNum >= 2, double, S2y, (*this)[16]);
 
-  READ_GETTER(double, S2y, (*this)[16]);
+  OPT_READ_GETTER(SpinNum >= 2, double, S2z, (*this)[17]);
 
-  READ_GETTER(double, S2z, (*this)[17]);
+  OPT_READ_GETTER(SpinNum >= 3, double, S3x, (*this)[18]);
 
-  READ_GETTER(double, S3x, (*this)[18]);
+  OPT_READ_GETTER(SpinNum >= 3, double, S3y, (*this)[19]);
 
-  READ_GETTER(double, S3y, (*this)[19]);
+  OPT_READ_GETTER(SpinNum >= 3, double, S3z, (*this)[20]);
 
-  READ_GETTER(double, S3z, (*this)[20]);
+  OPT_VEC3_GETTER(SpinNum >= 2, S1, (*this)[12], (*this)[13], (*this)[14]);
 
-  STD_3WAY_SETTER(S1, (*this)[12], (*this)[13], (*this)[14]);
+  OPT_VEC3_GETTER(SpinNum >= 2, S2, (*this)[15], (*this)[16], (*this)[17]);
 
-  STD_3WAY_SETTER(S2, (*this)[15], (*this)[16], (*this)[17]);
+  OPT_VEC3_GETTER(SpinNum >= 3, S3, (*this)[18], (*this)[19], (*this)[20]);
 
-  STD_3WAY_SETTER(S3, (*this)[18], (*this)[19], (*this)[20]);
+  OPT_3WAY_SETTER(SpinNum >= 2, S1, (*this)[12], (*this)[13], (*this)[14]);
+
+  OPT_3WAY_SETTER(SpinNum >= 2, S2, (*this)[15], (*this)[16], (*this)[17]);
+
+  OPT_3WAY_SETTER(SpinNum >= 3, S3, (*this)[18], (*this)[19], (*this)[20]);
 
   friend std::ostream &operator<<(std::ostream &os, SecularArray const &arr) {
     for (auto a : arr) {
@@ -115,27 +130,39 @@ class SecularArray : public std::array<double, 21> {
 struct Controller {
   double stop_a_in() const { return GW_stop_a_; }
 
-  double GW_in_ratio;
-  double GW_out_ratio;
-  LK_method ave_method;
+  double GW_in_ratio{0};
+  double GW_out_ratio{0};
+  LK_method ave_method{LK_method::DA};
+  bool hybrid{false};
+  double hybrid_ratio{1};
   bool Quad{true};
   bool Oct{false};
-  bool GR_in;
-  bool GR_out;
-  bool GW_in;
-  bool GW_out;
-  deS Sin_Lin;
-  deS Sin_Lout;
-  deS Sout_Lin;
-  deS Sout_Lout;
-  deS Sin_Sin;
-  deS Sin_Sout;
-  deS LL;
+  bool GR_in{false};
+  bool GR_out{false};
+  bool GW_in{false};
+  bool GW_out{false};
+  deS Sin_Lin{deS::off};
+  deS Sin_Lout{deS::off};
+  deS Sout_Lin{deS::off};
+  deS Sout_Lout{deS::off};
+  deS Sin_Sin{deS::off};
+  deS Sin_Sout{deS::off};
+  deS LL{deS::off};
 
   void set_stop_a_in(double a_stop) { GW_stop_a_ = a_stop; }
 
+  /* DA quadrupole and nothing else, for tools that set the switches in code instead of reading a config */
+  Controller() = default;
+
   Controller(space::tools::ConfigReader &cfg) {
-    ave_method = str_to_LK_enum(cfg.get<std::string>("LK_method"));
+    std::string const method = cfg.get<std::string>("LK_method");
+
+    // 'hybrid' starts every task in DA and drops to SA while the double average breaks down (see hybrid.h)
+    hybrid = case_insens_equals(method, "hybrid");
+
+    ave_method = hybrid ? LK_method::DA : str_to_LK_enum(method);
+
+    hybrid_ratio = get_optional<double>(cfg, "hybrid_ratio", 1.0);
 
     Quad = str_to_bool(cfg.get<std::string>("quad"));
 
@@ -168,27 +195,27 @@ struct Controller {
     LL = str_to_spin_orbit_enum(cfg.get<std::string>("LL"));
   }
 
-  std::string initial_format() {
+  std::string initial_format() const {
     std::string base =
         "task_id  t_{end}[yr]  dt_{output}[yr]  m_{1}[m_{solar}]  m_{2}[m_{solar}]  m_{3}[m_{solar}]  a_{in}[au]  "
         "a_{out}[au]  e_{in}  e_{out}  omega_{in}[deg]  omega_{out}[deg]  Omega[deg]  i_{in}[deg]  i_{out}[deg]";
 
-    if (need_anomaly()) {
+    if (need_anomaly() || hybrid) {
       base += "  M(mean anomaly)[deg]";
     }
 
-    if (need_S_in()) {
+    if (spin_num() >= 2) {
       base += "  S_{1,x}  S_{1,y}  S_{1,z}  S_{2,x}  S_{2,y}  S_{2,z}";
     }
 
-    if (need_S_out()) {
+    if (spin_num() >= 3) {
       base += "  S_{3,x}  S_{3,y}  S_{3,z}";
     }
 
     return base;
   }
 
-  std::string output_format() {
+  std::string output_format() const {
     std::string base = "t[yr]  L_{1,x}[?]  L_{1,y}[?]  L_{1,z}[?]  e_{1,x}  e_{1,y}  e_{1,z}";
 
     if (need_anomaly()) {
@@ -197,27 +224,32 @@ struct Controller {
       base += "  L_{2,x}[?]  L_{2,y}[?]  L_{2,z}[?]  e_{2,x}  e_{2,y}  e_{2,z}";
     }
 
-    if (need_S_in()) {
+    if (spin_num() >= 2) {
       base += "  S_{1,x}  S_{1,y}  S_{1,z}  S_{2,x}  S_{2,y}  S_{2,z}";
     }
 
-    if (need_S_out()) {
+    if (spin_num() >= 3) {
       base += "  S_{3,x}  S_{3,y}  S_{3,z}";
     }
 
     return base;
   }
 
-  bool need_anomaly() { return ave_method == LK_method::SA; }
+  bool need_anomaly() const { return ave_method == LK_method::SA; }
 
-  bool need_S_in() {
+  bool need_S_in() const {
     return (Sin_Lin != deS::off) || (Sin_Lout != deS::off) || (Sin_Sin != deS::off) || (Sin_Sout != deS::off);
   }
 
-  bool need_S_out() { return (Sout_Lin != deS::off) || (Sout_Lout != deS::off) || (Sin_Sout != deS::off); }
+  bool need_S_out() const { return (Sout_Lin != deS::off) || (Sout_Lout != deS::off) || (Sin_Sout != deS::off); }
+
+  /* number of spin vectors carried by the state; the slots are positional, so S_out implies S_in */
+  size_t spin_num() const { return need_S_out() ? 3 : (need_S_in() ? 2 : 0); }
+
+  size_t state_dim() const { return 12 + 3 * spin_num(); }
 
  private:
-  double GW_stop_a_;
+  double GW_stop_a_{0};
 };
 
 class SecularConst {
@@ -320,25 +352,148 @@ class SecularConst {
   };
 };
 
-template <typename Container>
+/*---------------------------------------------------------------------------*\
+        compile-time controller
+\*---------------------------------------------------------------------------*/
+/*
+ * The deS couplings a state with SpinNum spins can carry. Only the couplings the state has no slots for are
+ * compile-time (off); those of the spin-carrying states are run-time members copied from Controller, since
+ * dispatching their on/off states as well would multiply the kernels of a spin configuration by up to 2^6.
+ */
+template <size_t SpinNum>
+struct Spin_switch;
+
+template <>
+struct Spin_switch<0> {
+  template <typename Ctrl>
+  explicit Spin_switch(Ctrl const &ctrl) {}
+
+  static constexpr deS Sin_Lin{deS::off};
+  static constexpr deS Sin_Lout{deS::off};
+  static constexpr deS Sout_Lin{deS::off};
+  static constexpr deS Sout_Lout{deS::off};
+  static constexpr deS Sin_Sin{deS::off};
+  static constexpr deS Sin_Sout{deS::off};
+};
+
+template <>
+struct Spin_switch<2> {
+  template <typename Ctrl>
+  explicit Spin_switch(Ctrl const &ctrl) : Sin_Lin{ctrl.Sin_Lin}, Sin_Lout{ctrl.Sin_Lout}, Sin_Sin{ctrl.Sin_Sin} {}
+
+  deS Sin_Lin;
+  deS Sin_Lout;
+  static constexpr deS Sout_Lin{deS::off};
+  static constexpr deS Sout_Lout{deS::off};
+  deS Sin_Sin;
+  static constexpr deS Sin_Sout{deS::off};
+};
+
+template <>
+struct Spin_switch<3> {
+  template <typename Ctrl>
+  explicit Spin_switch(Ctrl const &ctrl)
+      : Sin_Lin{ctrl.Sin_Lin},
+        Sin_Lout{ctrl.Sin_Lout},
+        Sout_Lin{ctrl.Sout_Lin},
+        Sout_Lout{ctrl.Sout_Lout},
+        Sin_Sin{ctrl.Sin_Sin},
+        Sin_Sout{ctrl.Sin_Sout} {}
+
+  deS Sin_Lin;
+  deS Sin_Lout;
+  deS Sout_Lin;
+  deS Sout_Lout;
+  deS Sin_Sin;
+  deS Sin_Sout;
+};
+
+/*
+ * Same interface as Controller, but ave_method, Oct, GR_in, GW_in and the number of spins are compile-time
+ * constants, so the dead physics is folded out of the kernel. GR_out and LL are rare and stay run-time, and so do
+ * the deS couplings of a state that carries spins (see Spin_switch); a task without spins is branch-free.
+ */
+template <LK_method Method, bool Octupole, bool GR_inner, bool GW_inner, size_t SpinNum>
+struct Static_controller : public Spin_switch<SpinNum> {
+  using Container = SecularArray<SpinNum>;
+
+  explicit Static_controller(Controller const &ctrl)
+      : Spin_switch<SpinNum>{ctrl}, GR_out{ctrl.GR_out}, LL{ctrl.LL} {}
+
+  /* the same physics with the other averaging, for hybrid runs */
+  template <LK_method Other>
+  using with_method = Static_controller<Other, Octupole, GR_inner, GW_inner, SpinNum>;
+
+  static constexpr LK_method ave_method{Method};
+  static constexpr bool Quad{true};
+  static constexpr bool Oct{Octupole};
+  static constexpr bool GR_in{GR_inner};
+  static constexpr bool GW_in{GW_inner};
+  static constexpr size_t spin_num{SpinNum};
+  bool GR_out;
+  deS LL;
+};
+
+template <typename Func>
+inline auto spin_dispatch(size_t spin_num, Func &&func) {
+  if (spin_num == 3) {
+    return func(std::integral_constant<size_t, 3>{});
+  } else if (spin_num == 2) {
+    return func(std::integral_constant<size_t, 2>{});
+  } else {
+    return func(std::integral_constant<size_t, 0>{});
+  }
+}
+
+/*
+ * Resolve the run-time Controller into a Static_controller and invoke func with it. Every branch of
+ * the switch must return the same type.
+ */
+template <typename Func>
+auto static_dispatch(Controller const &ctrl, Func &&func) {
+  auto method_dispatch = [&](auto oct, auto gr_in, auto gw_in, auto spin) {
+    constexpr bool Oct = decltype(oct)::value;
+    constexpr bool GR_in = decltype(gr_in)::value;
+    constexpr bool GW_in = decltype(gw_in)::value;
+    constexpr size_t SpinNum = decltype(spin)::value;
+
+    if (ctrl.ave_method == LK_method::DA) {
+      return func(Static_controller<LK_method::DA, Oct, GR_in, GW_in, SpinNum>{ctrl});
+    } else {
+      return func(Static_controller<LK_method::SA, Oct, GR_in, GW_in, SpinNum>{ctrl});
+    }
+  };
+
+  return bool_dispatch(ctrl.Oct, [&](auto oct) {
+    return bool_dispatch(ctrl.GR_in, [&](auto gr_in) {
+      return bool_dispatch(ctrl.GW_in, [&](auto gw_in) {
+        return spin_dispatch(ctrl.spin_num(), [&](auto spin) { return method_dispatch(oct, gr_in, gw_in, spin); });
+      });
+    });
+  });
+}
+
+template <typename Container, typename Ctrl = Controller>
 struct Dynamic_dispatch {
   using ConstArg = SecularConst;
 
-  Dynamic_dispatch(Controller const &_ctrl, ConstArg const &_args) : ctrl{&_ctrl}, args{&_args} {}
+  Dynamic_dispatch(Ctrl const &_ctrl, ConstArg const &_args) : ctrl{&_ctrl}, args{&_args} {}
 
   void operator()(Container const &x, Container &dxdt, double t) {
     std::fill(dxdt.begin(), dxdt.end(), 0);
 
-    Lidov_Kozai(*ctrl, *args, x, dxdt);
+    Orbit_context const orbits{*args, x, ctrl->ave_method == LK_method::DA};
+
+    Lidov_Kozai(*ctrl, *args, x, dxdt, orbits);
 
-    spin_orbit_coupling(*ctrl, *args, x, dxdt);
+    spin_orbit_coupling(*ctrl, *args, x, dxdt, orbits);
 
-    GR_precession(*ctrl, *args, x, dxdt);
+    GR_precession(*ctrl, *args, x, dxdt, orbits);
 
-    GW_radiation(*ctrl, *args, x, dxdt);
+    GW_radiation(*ctrl, *args, x, dxdt, orbits);
   }
 
-  Controller const *ctrl;
+  Ctrl const *ctrl;
   SecularConst const *args;
 };
 }  // namespace secular
@@ -5,16 +5,17 @@
 #include <tuple>
 
 #include "SpaceHub/src/orbits/orbits.hpp"
-#include "SpaceHub/src/rand-generator.hpp"
 #include "tools.h"
 namespace secular {
 
 double stellar_age(double m, double Z) { return 10e10 * pow(m, -2.5); }
 
-auto kick(double _1D_sigma) {
-  double vx = space::random::Normal(0, _1D_sigma);
-  double vy = space::random::Normal(0, _1D_sigma);
-  double vz = space::random::Normal(0, _1D_sigma);
+/* draws from the stream of the task (a Counter_rng), which is safe to use from any thread, unlike a global one */
+template <typename Rng>
+auto kick(Rng &rng, double _1D_sigma) {
+  double vx = rng.normal(0, _1D_sigma);
+  double vy = rng.normal(0, _1D_sigma);
+  double vz = rng.normal(0, _1D_sigma);
 
   return std::make_tuple(vx, vy, vz);
 }
@@ -167,16 +168,16 @@ auto to_pos_vel_out(Args const &args, Container const &var, double M_nu) {
   return std::make_tuple(r * npx, r * npy, r * npz, ve * e2x + vv * nvx, ve * e2y + vv * nvy, ve * e2z + vv * nvz)
 }*/
 
-template <typename Ctrl, typename Args, typename Container>
-bool stellar(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar, double t) {
+template <typename Ctrl, typename Args, typename Container, typename Rng>
+bool stellar(Ctrl const &ctrl, Args const &args, Container const &var, Container &dvar, double t, Rng &rng) {
   if (!args.m1_dead() && t > args.m1_age()) {
-    double M_anomaly = space::random::Uniform(-consts::pi, consts::pi);
+    double M_anomaly = rng.uniform(-consts::pi, consts::pi);
 
     auto [px, py, pz, vx, vy, vz] = to_pos_vel(args, var, M_anomaly);
 
     args.make_m1_exploded();
 
-    auto [kick_vx, kick_vy, kick_vz] = kick(1);
+    auto [kick_vx, kick_vy, kick_vz] = kick(rng, 1);
 
     vx += kick_vx, vy += kick_vy, vz += kick_vz;
 
@@ -0,0 +1,263 @@
+#ifndef SECULAR_STEPPER_H
+#define SECULAR_STEPPER_H
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "boost/numeric/odeint.hpp"
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * The integrators behind 'stepper =': Bulirsch-Stoer (the default), Runge-Kutta-Fehlberg 7(8), Dormand-Prince
+ * 5(4) and Cash-Karp 5(4). Only BS and DP5 have a dense output in odeint, so a run that needs one (dense_output,
+ * events) with RKF78 or CK is an input error rather than a silent switch to DP5.
+ */
+enum class Stepper_type { BS, RKF78, DP5, CK };
+
+Stepper_type str_to_stepper_type(std::string const &key) {
+  if (case_insens_equals(key, "BS")) {
+    return Stepper_type::BS;
+  } else if (case_insens_equals(key, "RKF78")) {
+    return Stepper_type::RKF78;
+  } else if (case_insens_equals(key, "DP5")) {
+    return Stepper_type::DP5;
+  } else if (case_insens_equals(key, "CK")) {
+    return Stepper_type::CK;
+  } else {
+    throw ReturnFlag::input_err;
+  }
+}
+
+/*
+ * Tuning of the stepper family:
+ *   max_dt                      upper bound of the step size in yr, 0 for none (all steppers);
+ *   BS_factor_x, BS_factor_dxdt weights of the state and of its derivative in the BS error scale;
+ *   RK_safety                   safety factor of the RK step size control;
+ *   RK_max_grow, RK_max_shrink  bounds of the factor by which one RK step may change the step size;
+ *   initial_dt                  step size a task starts with in yr, 'auto' to estimate it from the RHS.
+ * BS picks its extrapolation order itself, up to the fixed maximum of odeint.
+ */
+struct Stepper_config {
+  Stepper_config() = default;
+
+  template <typename Config>
+  explicit Stepper_config(Config &cfg) {
+    type = str_to_stepper_type(get_optional<std::string>(cfg, "stepper", "BS"));
+
+    max_dt = get_optional<double>(cfg, "max_dt", 0.0) * consts::year;
+
+    BS_factor_x = get_optional<double>(cfg, "BS_factor_x", 1.0);
+
+    BS_factor_dxdt = get_optional<double>(cfg, "BS_factor_dxdt", 1.0);
+
+    RK_safety = get_optional<double>(cfg, "RK_safety", 0.9);
+
+    RK_max_grow = get_optional<double>(cfg, "RK_max_grow", 5.0);
+
+    RK_max_shrink = get_optional<double>(cfg, "RK_max_shrink", 0.2);
+
+    std::string const init = get_optional<std::string>(cfg, "initial_dt", "auto");
+
+    initial_dt = case_insens_equals(init, "auto") ? 0.0 : std::stod(init) * consts::year;
+
+    if (RK_safety <= 0 || RK_safety > 1 || RK_max_grow < 1 || RK_max_shrink <= 0 || RK_max_shrink > 1 ||
+        max_dt < 0 || initial_dt < 0) {
+      throw ReturnFlag::input_err;
+    }
+  }
+
+  /* true if odeint has a dense-output version of the stepper */
+  bool has_dense_output() const { return type == Stepper_type::BS || type == Stepper_type::DP5; }
+
+  Stepper_type type{Stepper_type::BS};
+  double max_dt{0};
+  double BS_factor_x{1};
+  double BS_factor_dxdt{1};
+  double RK_safety{0.9};
+  double RK_max_grow{5};
+  double RK_max_shrink{0.2};
+  double initial_dt{0};
+};
+
+/* order of the solution, which sets how the initial step scales with the tolerance */
+inline int stepper_order(Stepper_type type) {
+  switch (type) {
+    case Stepper_type::RKF78:
+      return 7;
+    case Stepper_type::DP5:
+    case Stepper_type::CK:
+      return 5;
+    default:
+      return 8;
+  }
+}
+
+/* odeint's default_step_adjuster with the safety factor and the growth and shrink bounds taken from the config */
+template <typename Value, typename Time>
+class Tuned_step_adjuster {
+ public:
+  using time_type = Time;
+  using value_type = Value;
+
+  Tuned_step_adjuster(Stepper_config const &cfg = Stepper_config{})
+      : safety_{cfg.RK_safety}, max_grow_{cfg.RK_max_grow}, max_shrink_{cfg.RK_max_shrink}, max_dt_{cfg.max_dt} {}
+
+  time_type decrease_step(time_type dt, value_type error, int error_order) const {
+    dt *= std::max(safety_ * pow(error, -1.0 / (error_order - 1)), max_shrink_);
+    return limit(dt);
+  }
+
+  time_type increase_step(time_type dt, value_type error, int stepper_order) const {
+    if (error < 0.5) {
+      error = std::max(pow(max_grow_ / safety_, -stepper_order), error);
+      dt = limit(dt * safety_ * pow(error, -1.0 / stepper_order));
+    }
+    return dt;
+  }
+
+  bool check_step_size_limit(time_type dt) const { return max_dt_ == 0 || fabs(dt) <= max_dt_; }
+
+  time_type get_max_dt() const { return max_dt_; }
+
+ private:
+  value_type safety_;
+  value_type max_grow_;
+  value_type max_shrink_;
+  time_type max_dt_;
+
+  time_type limit(time_type dt) const { return max_dt_ != 0 && fabs(dt) > max_dt_ ? std::copysign(max_dt_, dt) : dt; }
+};
+
+template <typename ErrorStepper>
+using Tuned_controlled = boost::numeric::odeint::controlled_runge_kutta<
+    ErrorStepper,
+    boost::numeric::odeint::default_error_checker<typename ErrorStepper::value_type,
+                                                  typename ErrorStepper::algebra_type,
+                                                  typename ErrorStepper::operations_type>,
+    Tuned_step_adjuster<typename ErrorStepper::value_type, typename ErrorStepper::time_type>>;
+
+template <typename ErrorStepper>
+Tuned_controlled<ErrorStepper> make_tuned_controlled(Stepper_config const &cfg, double atol, double rtol) {
+  using Checker = typename Tuned_controlled<ErrorStepper>::error_checker_type;
+  using Adjuster = typename Tuned_controlled<ErrorStepper>::step_adjuster_type;
+  return Tuned_controlled<ErrorStepper>{Checker{atol, rtol}, Adjuster{cfg}};
+}
+
+/* invoke func with a fresh stepper of the configured family that offers try_step(system, x, t, dt) */
+template <typename Container, typename Func>
+auto controlled_stepper_dispatch(Stepper_config const &cfg, double atol, double rtol, Func &&func) {
+  using namespace boost::numeric::odeint;
+
+  switch (cfg.type) {
+    case Stepper_type::RKF78:
+      return func(make_tuned_controlled<runge_kutta_fehlberg78<Container>>(cfg, atol, rtol));
+    case Stepper_type::DP5:
+      return func(make_tuned_controlled<runge_kutta_dopri5<Container>>(cfg, atol, rtol));
+    case Stepper_type::CK:
+      return func(make_tuned_controlled<runge_kutta_cash_karp54<Container>>(cfg, atol, rtol));
+    default:
+      return func(bulirsch_stoer<Container>{atol, rtol, cfg.BS_factor_x, cfg.BS_factor_dxdt, cfg.max_dt});
+  }
+}
+
+/* invoke func with a fresh dense-output stepper (initialize, do_step, calc_state) of the configured family */
+template <typename Container, typename Func>
+auto dense_stepper_dispatch(Stepper_config const &cfg, double atol, double rtol, Func &&func) {
+  using namespace boost::numeric::odeint;
+
+  if (cfg.type == Stepper_type::DP5) {
+    using Controlled = Tuned_controlled<runge_kutta_dopri5<Container>>;
+    return func(dense_output_runge_kutta<Controlled>{make_tuned_controlled<runge_kutta_dopri5<Container>>(cfg, atol,
+                                                                                                        rtol)});
+  } else {
+    return func(bulirsch_stoer_dense_out<Container>{atol, rtol, cfg.BS_factor_x, cfg.BS_factor_dxdt, cfg.max_dt});
+  }
+}
+
+template <typename Stepper, typename = void>
+struct has_reset : std::false_type {};
+
+template <typename Stepper>
+struct has_reset<Stepper, std::void_t<decltype(std::declval<Stepper &>().reset())>> : std::true_type {};
+
+/* forget the step history after the state was changed from outside, for the steppers that keep one */
+template <typename Stepper>
+void restart(Stepper &stepper) {
+  if constexpr (has_reset<Stepper>::value) {
+    stepper.reset();
+  }
+}
+
+template <typename Stepper>
+struct is_bulirsch_stoer : std::false_type {};
+
+template <typename... Args>
+struct is_bulirsch_stoer<boost::numeric::odeint::bulirsch_stoer<Args...>> : std::true_type {};
+
+/*
+ * make a stepper of controlled_stepper_dispatch continue from a state that was moved between its steps. BS takes
+ * the derivative anew in every try_step and keeps its order and step history; a FSAL stepper has to drop the
+ * derivative it carries over.
+ */
+template <typename Stepper>
+void state_moved(Stepper &stepper) {
+  if constexpr (!is_bulirsch_stoer<Stepper>::value) {
+    restart(stepper);
+  }
+}
+
+/*
+ * Starting step of Hairer, Norsett & Wanner, Solving ODEs I, II.4: the step over which an explicit Euler step
+ * and the change of the derivative stay within the tolerance, scaled by the order of the method. Costs two
+ * RHS evaluations.
+ */
+template <typename Container, typename Func>
+double initial_step(Stepper_config const &cfg, Stepper_type type, Func &func, Container const &x, double t,
+                    double atol, double rtol) {
+  if (cfg.initial_dt > 0) return cfg.initial_dt;
+
+  Container f0, f1, x1;
+
+  func(x, f0, t);
+
+  // the state is made of 3-vectors; a component is measured against the length of its vector, so that a vector
+  // lying in a coordinate plane does not ask for the step of the absolute tolerance
+  auto wrms = [&](auto &&element) {
+    double sum = 0;
+    for (size_t i = 0; i < x.size(); ++i) {
+      size_t const v = i - i % 3;
+      double const e = element(i) / (atol + rtol * norm(x[v], x[v + 1], x[v + 2]));
+      sum += e * e;
+    }
+    return sqrt(sum / x.size());
+  };
+
+  double const d0 = wrms([&](size_t i) { return x[i]; });
+
+  double const d1 = wrms([&](size_t i) { return f0[i]; });
+
+  double const h0 = (d0 < 1e-5 || d1 < 1e-5) ? 1e-6 : 0.01 * d0 / d1;
+
+  for (size_t i = 0; i < x.size(); ++i) {
+    x1[i] = x[i] + h0 * f0[i];
+  }
+
+  func(x1, f1, t + h0);
+
+  double const d2 = wrms([&](size_t i) { return f1[i] - f0[i]; }) / h0;
+
+  double const h1 = std::max(d1, d2) <= 1e-15 ? std::max(1e-6, 1e-3 * h0)
+                                              : pow(0.01 / std::max(d1, d2), 1.0 / (stepper_order(type) + 1));
+
+  double const h = std::min(100 * h0, h1);
+
+  return cfg.max_dt > 0 ? std::min(h, cfg.max_dt) : h;
+}
+
+}  // namespace secular
+#endif
@@ -0,0 +1,160 @@
+#ifndef SECULAR_TASK_POOL_H
+#define SECULAR_TASK_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+#include "LK.h"
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * Rough relative cost of one task, read from an input row (task_id, t_end, out_dt, m1, m2, m3, a_in, a_out,
+ * e_in, e_out, ...). The step count scales with the number of LK cycles in t_end; SA additionally resolves
+ * every outer orbit, and high inner eccentricities shrink the steps around the pericenter passages.
+ */
+template <typename Ctrl, typename Iter>
+double estimate_cost(Ctrl const &ctrl, Iter row) {
+  auto const [t_end, out_dt, m1, m2, m3, a_in, a_out, e_in, e_out] = unpack_args<9>(row + 1);
+
+  double const a_out_eff = a_out * sqrt(fabs(1 - e_out * e_out));
+
+  double cycles = t_end / t_k_quad(m1 + m2, m3, a_in, a_out_eff);
+
+  if (ctrl.ave_method == LK_method::SA) {
+    double const P_out = 2 * consts::pi * sqrt(a_out * a_out * a_out / (consts::G * (m1 + m2 + m3)));
+    cycles += t_end / P_out;
+  }
+
+  double const weight = 1 + 0.5 * ctrl.Oct + 0.25 * (ctrl.GR_in + ctrl.GW_in) + 0.25 * ctrl.spin_num();
+
+  return cycles * weight / sqrt(fabs(1 - e_in * e_in) + 1e-6);
+}
+
+/*
+ * All input rows, parsed up front and handed out longest-first. The rows are sorted by estimated cost and
+ * dealt round-robin into one deque per worker; a worker takes the most expensive task left in its own deque
+ * and, once that is empty, steals the most expensive task left at the front of the other deques, so no expensive
+ * task waits behind a running one while a worker is free. A sampled population
+ * keeps only the task ids, and generate(task_id, row) writes a row when its task is popped.
+ */
+class Task_pool {
+ public:
+  using Generator = std::function<void(size_t, double *)>;
+
+  Task_pool(std::vector<double> &&rows, size_t row_len, std::vector<double> const &cost, size_t worker_num)
+      : rows_{std::move(rows)}, row_len_{row_len}, next_worker_{0} {
+    deal(cost, worker_num);
+  }
+
+  Task_pool(Generator generate, std::vector<size_t> &&ids, size_t row_len, std::vector<double> const &cost,
+            size_t worker_num)
+      : generate_{std::move(generate)}, ids_{std::move(ids)}, row_len_{row_len}, next_worker_{0} {
+    deal(cost, worker_num);
+  }
+
+  size_t size() const { return generate_ ? ids_.size() : rows_.size() / row_len_; }
+
+  /* each worker thread calls this once to get the index of its own deque */
+  size_t register_worker() { return next_worker_++ % queues_.size(); }
+
+  bool pop(size_t worker, std::vector<double> &task) {
+    size_t id;
+    if (take_front(worker, id)) {
+      fetch(id, task);
+      return true;
+    }
+
+    for (;;) {
+      size_t victim = queues_.size();
+      double most = 0;
+
+      for (size_t k = 1; k < queues_.size(); ++k) {
+        size_t const q = (worker + k) % queues_.size();
+        double c;
+        if (front_cost(q, c) && (victim == queues_.size() || c > most)) {
+          most = c;
+          victim = q;
+        }
+      }
+
+      if (victim == queues_.size()) return false;
+
+      // another thief may have emptied the victim in between; then look again
+      if (take_front(victim, id)) {
+        fetch(id, task);
+        return true;
+      }
+    }
+  }
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<size_t> tasks;
+  };
+
+  std::vector<double> rows_;
+  Generator generate_;
+  std::vector<size_t> ids_;
+  std::vector<double> cost_;
+  size_t row_len_;
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::atomic<size_t> next_worker_;
+
+  void deal(std::vector<double> const &cost, size_t worker_num) {
+    worker_num = std::max(worker_num, static_cast<size_t>(1));
+
+    cost_ = cost;
+
+    std::vector<size_t> order(cost.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return cost[a] > cost[b]; });
+
+    for (size_t i = 0; i < worker_num; ++i) {
+      queues_.emplace_back(std::make_unique<Queue>());
+    }
+
+    for (size_t k = 0; k < order.size(); ++k) {
+      queues_[k % worker_num]->tasks.push_back(order[k]);
+    }
+  }
+
+  bool take_front(size_t q, size_t &id) {
+    std::lock_guard<std::mutex> lock{queues_[q]->mutex};
+    auto &tasks = queues_[q]->tasks;
+    if (tasks.empty()) return false;
+    id = tasks.front();
+    tasks.pop_front();
+    return true;
+  }
+
+  /* the cost of the task at the front of deque q; false if it is empty */
+  bool front_cost(size_t q, double &cost) {
+    std::lock_guard<std::mutex> lock{queues_[q]->mutex};
+    auto const &tasks = queues_[q]->tasks;
+    if (tasks.empty()) return false;
+    cost = cost_[tasks.front()];
+    return true;
+  }
+
+  void fetch(size_t id, std::vector<double> &task) const {
+    if (generate_) {
+      task.resize(row_len_);
+      generate_(ids_[id], task.data());
+      return;
+    }
+    auto begin = rows_.begin() + id * row_len_;
+    task.assign(begin, begin + row_len_);
+  }
+};
+
+}  // namespace secular
+#endif
@@ -0,0 +1,111 @@
+#ifndef SECULAR_TELEMETRY_H
+#define SECULAR_TELEMETRY_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace secular {
+
+/*
+ * What one task cost: the RHS evaluations, accepted and rejected steps, the accepted step sizes and the wall
+ * time from its start to its return. Step sizes go into a histogram in log10(dt) with dt_bins_per_decade bins per
+ * decade; the median is read off the histogram, interpolated within its bin.
+ *
+ * A lane of a batch counts the evaluations made while it was loaded and the wall time it was occupied, which it
+ * shares with the other lanes. The dense-output stepper retries a rejected step inside do_step, so its rejections
+ * are not seen and are reported as '-'. Tasks propagated in closed form take no steps. The number of orbit projections
+ * and the largest correction are reported as '-' for a task run without projection.
+ */
+class Task_stats {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr int dt_bins_per_decade = 10;
+
+  Task_stats() : start_{Clock::now()} {}
+
+  size_t rhs_calls{0};
+
+  size_t accepted{0};
+
+  size_t rejected{0};
+
+  bool rejects_counted{true};
+
+  bool projecting{false};
+
+  size_t projections{0};
+
+  void accept(double dt) {
+    accepted++;
+    dt_min_ = std::min(dt_min_, dt);
+    dt_max_ = std::max(dt_max_, dt);
+    if (dt > 0) {
+      histogram_[static_cast<int>(std::floor(std::log10(dt) * dt_bins_per_decade))]++;
+    }
+  }
+
+  void reject() { rejected++; }
+
+  /* records the correction of one orbit projection (see projection.h) */
+  void project(double correction) {
+    projections++;
+    max_projection_ = std::max(max_projection_, correction);
+  }
+
+  double max_projection() const { return max_projection_; }
+
+  double wall_time() const { return std::chrono::duration<double>(Clock::now() - start_).count(); }
+
+  double dt_min() const { return accepted > 0 ? dt_min_ : 0; }
+
+  double dt_max() const { return accepted > 0 ? dt_max_ : 0; }
+
+  double dt_median() const {
+    size_t total = 0;
+    for (auto const &[bin, count] : histogram_) total += count;
+
+    double const half = 0.5 * total;
+
+    size_t below = 0;
+    for (auto const &[bin, count] : histogram_) {
+      if (below + count >= half) {
+        double const frac = count > 0 ? (half - below) / count : 0;
+        double const dt = std::pow(10.0, (bin + frac) / dt_bins_per_decade);
+        return std::clamp(dt, dt_min(), dt_max());
+      }
+      below += count;
+    }
+    return 0;
+  }
+
+  /* "<log10 of the lower bin edge>:<steps>" for every non-empty bin, comma separated; '-' without steps */
+  std::string dt_histogram() const {
+    if (histogram_.empty()) return "-";
+
+    std::ostringstream os;
+    os << std::setprecision(4);
+    for (auto it = histogram_.begin(); it != histogram_.end(); ++it) {
+      os << (it == histogram_.begin() ? "" : ",") << static_cast<double>(it->first) / dt_bins_per_decade << ':'
+         << it->second;
+    }
+    return os.str();
+  }
+
+ private:
+  Clock::time_point start_;
+  double dt_min_{std::numeric_limits<double>::max()};
+  double dt_max_{0};
+  double max_projection_{0};
+  std::map<int, size_t> histogram_;
+};
+
+}  // namespace secular
+#endif
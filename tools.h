@@ -5,6 +5,7 @@
 #include <cmath>
 #include <sstream>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 namespace secular {
 
@@ -35,41 +36,44 @@ namespace secular {
   inline void set_##NAME(double x, double y, double z) { X = x, Y = y, Z = z; }    \
   inline void add_##NAME(double x, double y, double z) { X += x, Y += y, Z += z; } \
   inline void sub_##NAME(double x, double y, double z) { X -= x, Y -= y, Z -= z; } \
-  inline void set_##NAME(std::tuple<double, double, double> const &t) {            \
-    X = std::get<0>(t), Y = std::get<1>(t), Z = std::get<2>(t);                    \
-  }                                                                                \
-  inline void add_##NAME(std::tuple<double, double, double> const &t) {            \
-    X += std::get<0>(t), Y += std::get<1>(t), Z += std::get<2>(t);                 \
-  }                                                                                \
-  inline void sub_##NAME(std::tuple<double, double, double> const &t) {            \
-    X -= std::get<0>(t), Y -= std::get<1>(t), Z -= std::get<2>(t);                 \
+  inline void set_##NAME(Vec3 const &v) { X = v.x, Y = v.y, Z = v.z; }            \
+  inline void add_##NAME(Vec3 const &v) { X += v.x, Y += v.y, Z += v.z; }          \
+  inline void sub_##NAME(Vec3 const &v) { X -= v.x, Y -= v.y, Z -= v.z; }
+
+#define OPT_3WAY_SETTER(COND, NAME, X, Y, Z)             \
+  inline void set_##NAME(double x, double y, double z) { \
+    static_assert(COND, "method is not defined!");       \
+    X = x, Y = y, Z = z;                                 \
+  }                                                      \
+  inline void add_##NAME(double x, double y, double z) { \
+    static_assert(COND, "method is not defined!");       \
+    X += x, Y += y, Z += z;                              \
+  }                                                      \
+  inline void sub_##NAME(double x, double y, double z) { \
+    static_assert(COND, "method is not defined!");       \
+    X -= x, Y -= y, Z -= z;                              \
+  }                                                      \
+  inline void set_##NAME(Vec3 const &v) {                \
+    static_assert(COND, "method is not defined!");       \
+    X = v.x, Y = v.y, Z = v.z;                           \
+  }                                                      \
+  inline void add_##NAME(Vec3 const &v) {                \
+    static_assert(COND, "method is not defined!");       \
+    X += v.x, Y += v.y, Z += v.z;                        \
+  }                                                      \
+  inline void sub_##NAME(Vec3 const &v) {                \
+    static_assert(COND, "method is not defined!");       \
+    X -= v.x, Y -= v.y, Z -= v.z;                        \
   }
 
-#define OPT_3WAY_SETTER(COND, NAME, X, Y, Z)                            \
-  inline void set_##NAME(double x, double y, double z) {                \
-    static_assert(COND, "method is not defined!");                      \
-    X = x, Y = y, Z = z;                                                \
-  }                                                                     \
-  inline void add_##NAME(double x, double y, double z) {                \
-    static_assert(COND, "method is not defined!");                      \
-    X += x, Y += y, Z += z;                                             \
-  }                                                                     \
-  inline void sub_##NAME(double x, double y, double z) {                \
-    static_assert(COND, "method is not defined!");                      \
-    X -= x, Y -= y, Z -= z;                                             \
-  }                                                                     \
-  inline void set_##NAME(std::tuple<double, double, double> const &t) { \
-    static_assert(COND, "method is not defined!");                      \
-    X = std::get<0>(t), Y = std::get<1>(t), Z = std::get<2>(t);         \
-  }                                                                     \
-  inline void add_##NAME(std::tuple<double, double, double> const &t) { \
-    static_assert(COND, "method is not defined!");                      \
-    X += std::get<0>(t), Y += std::get<1>(t), Z += std::get<2>(t);      \
-  }                                                                     \
-  inline void sub_##NAME(std::tuple<double, double, double> const &t) { \
-    static_assert(COND, "method is not defined!");                      \
-    X -= std::get<0>(t), Y -= std::get<1>(t), Z -= std::get<2>(t);      \
-  }
+#define VEC3_GETTER(NAME, X, Y, Z) \
+  inline Vec3 NAME() const { return Vec3{X, Y, Z}; };
+
+#define OPT_VEC3_GETTER(COND, NAME, X, Y, Z)       \
+  inline Vec3 NAME() const {                       \
+    static_assert(COND, "method is not defined!"); \
+    return Vec3{X, Y, Z};                          \
+  };
 
 template <typename Iter, size_t... I>
 inline auto _unpack_array_(Iter iter, std::index_sequence<I...>) {
@@ -114,7 +118,7 @@ constexpr double r_G_sqrt = 1.0 / (2 * pi);
 constexpr double year = 1;
 }  // namespace consts
 
-enum class ReturnFlag { input_err, max_iter, finish };
+enum class ReturnFlag { input_err, max_iter, finish, interrupt, event, quiescent };
 
 bool case_insens_equals(std::string const &a, std::string const &b) {
   return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char a, char b) { return tolower(a) == tolower(b); });
@@ -136,6 +140,25 @@ bool str_to_bool(std::string const &key) {
 
 bool is_on(double x) { return x > 5e-15; }
 
+/* read an optional key from the config file, falling back to default_val when it is absent */
+template <typename T, typename Config>
+T get_optional(Config &cfg, std::string const &key, T const &default_val) {
+  try {
+    return cfg.template get<T>(key);
+  } catch (...) {
+    return default_val;
+  }
+}
+
+template <typename Func>
+inline auto bool_dispatch(bool flag, Func &&func) {
+  if (flag) {
+    return func(std::true_type{});
+  } else {
+    return func(std::false_type{});
+  }
+}
+
 template <typename Container>
 struct spin_num {
   static constexpr size_t size{Container::s_num};
@@ -175,6 +198,55 @@ inline auto cross_with_coef(double A, Tup3d const &t1, Tup3d const &t2) {
   return cross_with_coef(A, UNPACK3(t1), UNPACK3(t2));
 }
 
+/*
+ * 3-vector of the RHS kernels. It is three plain doubles, not a register padded to 4 lanes: the kernels are also
+ * inlined into the lane loops of batch.h, which vectorize across systems, and a 3-double aggregate is split into
+ * scalars by the compiler on both paths. Every operator works component by component in the operation order of the
+ * scalar helpers above, so a kernel written with Vec3 gives the same results as its scalar form.
+ */
+struct Vec3 {
+  double x;
+  double y;
+  double z;
+
+  inline Vec3 &operator+=(Vec3 const &v) {
+    x += v.x, y += v.y, z += v.z;
+    return *this;
+  }
+
+  inline Vec3 &operator-=(Vec3 const &v) {
+    x -= v.x, y -= v.y, z -= v.z;
+    return *this;
+  }
+};
+
+inline Vec3 operator+(Vec3 const &a, Vec3 const &b) { return Vec3{a.x + b.x, a.y + b.y, a.z + b.z}; }
+
+inline Vec3 operator-(Vec3 const &a, Vec3 const &b) { return Vec3{a.x - b.x, a.y - b.y, a.z - b.z}; }
+
+inline Vec3 operator-(Vec3 const &a) { return Vec3{-a.x, -a.y, -a.z}; }
+
+inline Vec3 operator*(double s, Vec3 const &a) { return Vec3{s * a.x, s * a.y, s * a.z}; }
+
+inline Vec3 operator*(Vec3 const &a, double s) { return Vec3{a.x * s, a.y * s, a.z * s}; }
+
+inline Vec3 operator/(Vec3 const &a, double s) { return Vec3{a.x / s, a.y / s, a.z / s}; }
+
+inline double norm2(Vec3 const &a) { return norm2(a.x, a.y, a.z); }
+
+inline double norm(Vec3 const &a) { return sqrt(norm2(a)); }
+
+inline double dot(Vec3 const &a, Vec3 const &b) { return dot(a.x, a.y, a.z, b.x, b.y, b.z); }
+
+inline Vec3 cross(Vec3 const &a, Vec3 const &b) {
+  return Vec3{a.y * b.z - b.y * a.z, a.z * b.x - b.z * a.x, a.x * b.y - b.x * a.y};
+}
+
+/* A (a x b), the scale applied to each component of the cross product rather than to an operand */
+inline Vec3 cross_with_coef(double A, Vec3 const &a, Vec3 const &b) {
+  return Vec3{A * (a.y * b.z - b.y * a.z), A * (a.z * b.x - b.z * a.x), A * (a.x * b.y - b.x * a.y)};
+}
+
 double calc_angular_mom(double m_in, double m_out, double a) {
   double mu = m_in * m_out / (m_in + m_out);
   return mu * sqrt(consts::G * (m_in + m_out) * a);
@@ -286,8 +358,8 @@ const std::string str_ll[4] = {
 
 template <typename Controler>
 std::string get_log_title(Controler const &ctrl) {
-  return std::string{"config:"} + str_ave[to_index(ctrl.ave_method)] + str_pole[ctrl.Oct] + str_gr_in[ctrl.GR_in] +
-         str_gr_out[ctrl.GR_out] + str_gw_in[ctrl.GW_in] + str_gw_out[ctrl.GW_out] +
+  return std::string{"config:"} + (ctrl.hybrid ? ":hybrid" : str_ave[to_index(ctrl.ave_method)]) + str_pole[ctrl.Oct] +
+         str_gr_in[ctrl.GR_in] + str_gr_out[ctrl.GR_out] + str_gw_in[ctrl.GW_in] + str_gw_out[ctrl.GW_out] +
          str_sin_lin[to_index(ctrl.Sin_Lin)] + str_sin_lout[to_index(ctrl.Sin_Lout)] +
          str_sout_lin[to_index(ctrl.Sout_Lin)] + str_sout_lout[to_index(ctrl.Sout_Lout)] +
          str_sin_sin[to_index(ctrl.Sin_Sin)] + str_sin_sout[to_index(ctrl.Sin_Sout)] + str_ll[to_index(ctrl.LL)];
@@ -0,0 +1,162 @@
+#ifndef SECULAR_TRAJECTORY_READER_H
+#define SECULAR_TRAJECTORY_READER_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace secular {
+
+/*
+ * Read-only view of a binary trajectory written by Stream_observer (see write_binary_header in observer.h).
+ * The file is memory-mapped, records are read in place without copying or parsing. A trajectory packed into
+ * an archive (see archive.h) is opened with the offset and length listed in archive_index.txt.
+ */
+class Trajectory_reader {
+ public:
+  explicit Trajectory_reader(std::string const &file_name) : Trajectory_reader{file_name, 0, 0} {}
+
+  Trajectory_reader(std::string const &file_name, size_t offset, size_t length) {
+    fd_ = ::open(file_name.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      throw std::runtime_error("cannot open " + file_name);
+    }
+
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+      ::close(fd_);
+      throw std::runtime_error("cannot stat " + file_name);
+    }
+
+    size_t const file_size = static_cast<size_t>(st.st_size);
+
+    size_ = length == 0 && offset < file_size ? file_size - offset : length;
+
+    if (offset + size_ > file_size || size_ < 8 + 5 * sizeof(uint64_t)) {
+      ::close(fd_);
+      throw std::runtime_error(file_name + " is not a secular binary trajectory");
+    }
+
+    size_t const page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+
+    map_offset_ = offset / page * page;
+
+    map_size_ = offset + size_ - map_offset_;
+
+    void *addr = ::mmap(nullptr, map_size_, PROT_READ, MAP_PRIVATE, fd_, static_cast<off_t>(map_offset_));
+    if (addr == MAP_FAILED) {
+      ::close(fd_);
+      throw std::runtime_error("cannot map " + file_name);
+    }
+
+    map_ = addr;
+
+    base_ = static_cast<char const *>(addr) + (offset - map_offset_);
+
+    try {
+      parse_header(file_name);
+    } catch (...) {
+      ::munmap(map_, map_size_);
+      ::close(fd_);
+      throw;
+    }
+
+    ::madvise(addr, map_size_, MADV_SEQUENTIAL);
+  }
+
+  Trajectory_reader(Trajectory_reader const &) = delete;
+
+  Trajectory_reader &operator=(Trajectory_reader const &) = delete;
+
+  ~Trajectory_reader() {
+    ::munmap(map_, map_size_);
+    ::close(fd_);
+  }
+
+  size_t task_id() const { return task_id_; }
+
+  std::string const &title() const { return title_; }
+
+  std::vector<std::string> const &column_names() const { return names_; }
+
+  /* number of doubles per record, the time included */
+  size_t columns() const { return columns_; }
+
+  /* number of complete records */
+  size_t size() const { return (size_ - header_size_) / (columns_ * sizeof(double)); }
+
+  double const *data() const { return reinterpret_cast<double const *>(base_ + header_size_); }
+
+  double const *record(size_t i) const { return data() + i * columns_; }
+
+  double time(size_t i) const { return record(i)[0]; }
+
+  double at(size_t i, size_t col) const { return record(i)[col]; }
+
+  /* column index by name, e.g. "e_{1,x}"; the unit suffix in brackets may be omitted */
+  size_t column(std::string const &name) const {
+    for (size_t j = 0; j < names_.size(); ++j) {
+      if (names_[j] == name || names_[j].compare(0, names_[j].find('['), name) == 0) {
+        return j;
+      }
+    }
+    throw std::out_of_range("no column " + name);
+  }
+
+ private:
+  void *map_{nullptr};
+  size_t map_offset_{0};
+  size_t map_size_{0};
+  char const *base_{nullptr};
+  size_t size_{0};
+  int fd_{-1};
+  size_t header_size_{0};
+  size_t task_id_{0};
+  size_t columns_{0};
+  std::string title_;
+  std::vector<std::string> names_;
+
+  void parse_header(std::string const &file_name) {
+    if (std::memcmp(base_, "SECULAR1", 8) != 0) {
+      throw std::runtime_error(file_name + " is not a secular binary trajectory");
+    }
+
+    size_t pos = 8;
+
+    auto get = [&]() {
+      uint64_t x;
+      std::memcpy(&x, base_ + pos, sizeof(x));
+      pos += sizeof(x);
+      return static_cast<size_t>(x);
+    };
+
+    header_size_ = get();
+    task_id_ = get();
+    columns_ = get();
+
+    size_t const title_len = get();
+    title_.assign(base_ + pos, title_len);
+    pos += title_len;
+
+    size_t const names_len = get();
+    std::istringstream names{std::string(base_ + pos, names_len)};
+    for (std::string name; names >> name;) {
+      names_.emplace_back(name);
+    }
+
+    if (header_size_ > size_ || columns_ == 0) {
+      throw std::runtime_error(file_name + " has a corrupted header");
+    }
+  }
+};
+
+}  // namespace secular
+#endif
@@ -0,0 +1,150 @@
+#ifndef SECULAR_TRIAGE_H
+#define SECULAR_TRIAGE_H
+
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+
+#include "archive.h"
+#include "events.h"
+#include "observer.h"
+#include "tools.h"
+
+namespace secular {
+
+/*
+ * 'triage = on' runs in two stages. Stage 1 integrates every task at a loose tolerance; a task whose outcome is
+ * clear is final there, any other is handed over to stage 2 and run again from its start at absolute_tolerance
+ * and relative_tolerance. The keys:
+ *   triage_tolerance  the absolute and relative tolerance of stage 1 (1e-8);
+ *   triage_margin     how close, relative to it, a task may come to a stopping threshold (GW_in, event_a_in,
+ *                     event_r_p) and still count as clear (0.1);
+ *   triage_e_max      the largest e_in a clear task may reach (0.99).
+ */
+struct Triage_config {
+  Triage_config() = default;
+
+  template <typename Config>
+  explicit Triage_config(Config &cfg) {
+    on = str_to_bool(get_optional<std::string>(cfg, "triage", "off"));
+
+    tol = get_optional<double>(cfg, "triage_tolerance", 1e-8);
+
+    margin = get_optional<double>(cfg, "triage_margin", 0.1);
+
+    e_max = get_optional<double>(cfg, "triage_e_max", 0.99);
+
+    if (tol <= 0 || margin < 0 || e_max <= 0) {
+      throw ReturnFlag::input_err;
+    }
+  }
+
+  bool on{false};
+  double tol{1e-8};
+  double margin{0.1};
+  double e_max{0.99};
+};
+
+/*
+ * The stage-1 verdicts of a run. A task is handed over unless it ran to t_end (or went quiescent) without an event
+ * and stayed clear of every threshold; events, max_iter and the GW stop all go to stage 2. Stage 1 ends a task as an
+ * event as soon as it crosses a threshold, since its loose outcome would be thrown away. Every stage-1 task gets a
+ * row in triage.txt, so a restarted run takes the tasks handed over before straight to stage 2. A handed-over task
+ * writes nothing else in stage 1, apart from the events it logs.
+ */
+class Triage {
+ public:
+  Triage(std::string const &work_dir, Triage_config const &cfg, Event_config const &events, double GW_in_ratio,
+         bool append)
+      : cfg_{cfg}, GW_in_ratio_{GW_in_ratio} {
+    auto const &a_in = events.setting[static_cast<size_t>(Event_type::a_in)];
+    auto const &r_p = events.setting[static_cast<size_t>(Event_type::r_p)];
+
+    a_in_ratio_ = a_in.action != Event_action::off ? a_in.threshold : 0;
+    r_p_limit_ = r_p.action != Event_action::off ? r_p.threshold : 0;
+
+    std::string const path = work_dir + "triage.txt";
+
+    if (append) {
+      read_handed_over(path);
+    }
+
+    file_.open(path, append ? std::fstream::out | std::fstream::app : std::fstream::out);
+
+    if (!append) {
+      file_ << "#task_id flag time[yr] e_max a_min[au] r_p_min[au] rhs_calls stage\r\n";
+    }
+    file_ << std::setprecision(12);
+  }
+
+  /* true once a task came too close to a threshold, or to e_in = 1, for its outcome to count as clear */
+  bool crossed(Orbit_summary const &s, double a_in_init) const {
+    double const near = 1 + cfg_.margin;
+
+    return s.e_max > cfg_.e_max || s.a_min < near * GW_in_ratio_ * a_in_init ||
+           s.a_min < near * a_in_ratio_ * a_in_init || s.r_p_min < near * r_p_limit_;
+  }
+
+  /* true if the stage-1 outcome of the task is not clear enough to be final */
+  bool unclear(Orbit_summary const &s, ReturnFlag flag, double time, double t_end, double a_in_init) const {
+    if (flag != ReturnFlag::finish && flag != ReturnFlag::quiescent) return true;
+
+    if (flag == ReturnFlag::finish && time < t_end) return true;
+
+    return crossed(s, a_in_init);
+  }
+
+  /* records the stage-1 outcome of task_id; true if the task was handed over to stage 2 */
+  bool record(size_t task_id, ReturnFlag flag, double time, double t_end, double a_in_init, Orbit_summary const &s,
+              size_t rhs_calls) {
+    bool const handed_over = unclear(s, flag, time, t_end, a_in_init);
+
+    std::ostringstream row;
+    row << std::setprecision(12) << task_id << ' ' << to_string(flag) << ' ' << time << ' ' << s.e_max << ' '
+        << s.a_min << ' ' << s.r_p_min << ' ' << rhs_calls << ' ' << (handed_over ? 2 : 1) << "\r\n";
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    file_ << row.str();
+    file_.flush();
+
+    if (handed_over) {
+      handed_over_.insert(task_id);
+    }
+    return handed_over;
+  }
+
+  /* only read between the stages, when no worker records any more */
+  bool handed_over(size_t task_id) const { return handed_over_.count(task_id) != 0; }
+
+  std::unordered_set<size_t> const &handed_over() const { return handed_over_; }
+
+ private:
+  Triage_config cfg_;
+  double GW_in_ratio_;
+  double a_in_ratio_{0};
+  double r_p_limit_{0};
+  std::ofstream file_;
+  std::mutex mutex_;
+  std::unordered_set<size_t> handed_over_;
+
+  void read_handed_over(std::string const &path) {
+    std::ifstream file{path};
+    for (std::string line; std::getline(file, line);) {
+      std::istringstream is{line};
+      size_t task_id, rhs_calls;
+      std::string flag;
+      double time, e_max, a_min, r_p_min;
+      int stage;
+      if (is >> task_id >> flag >> time >> e_max >> a_min >> r_p_min >> rhs_calls >> stage && stage == 2) {
+        handed_over_.insert(task_id);
+      }
+    }
+  }
+};
+
+}  // namespace secular
+#endif
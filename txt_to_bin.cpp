@@ -0,0 +1,24 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include "input.h"
+
+// the 25 columns of secular::input_columns()
+constexpr size_t PARAMETER_NUM = 25;
+
+int main(int argc, char **argv) {
+  std::ios::sync_with_stdio(false);
+
+  if (argc != 3) {
+    std::cout << "usage: " << argv[0] << " input.txt input.bin\n";
+    return 0;
+  }
+
+  secular::Input_table input{argv[1], PARAMETER_NUM};
+
+  std::ofstream out{argv[2], std::fstream::binary};
+
+  secular::write_binary_input(out, input.release(), PARAMETER_NUM);
+
+  return out ? 0 : 1;
+}